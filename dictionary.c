@@ -1,6 +1,372 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+////////////////////// PARTIE ALLOCATION //////////////////////////////
+
+/*
+    Compteur d'allocations : tous les malloc/calloc de ce fichier
+    passent par les fonctions ci-dessous (voir les #define).
+*/
+_Atomic unsigned long nb_malloc = 0;
+
+static void *counted_malloc(size_t size)
+{
+    nb_malloc++;
+    return malloc(size);
+}
+
+static void *counted_calloc(size_t nb, size_t size)
+{
+    nb_malloc++;
+    return calloc(nb, size);
+}
+
+#define malloc(size) counted_malloc(size)
+#define calloc(nb, size) counted_calloc(nb, size)
+
+/*
+    Arene : blocs chaines dans lesquels on alloue en avancant un pointeur.
+    On libere tout d'un coup (arena_reset) ou on revient a une marque
+    (arena_release) ; les blocs sont gardes pour etre reutilises, donc apres
+    le premier token il n'y a plus d'appel a malloc.
+*/
+#define ARENA_BLOCK_SIZE 65536
+#define ARENA_ALIGN 16
+
+struct arena_block {
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+};
+
+#define ARENA_HEADER ((sizeof(struct arena_block) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+struct arena {
+    struct arena_block *first;
+    struct arena_block *current;
+};
+
+struct arena_mark {
+    struct arena_block *block;
+    size_t used;
+};
+
+// arene des temporaires d'un token (mots lus, matrices, resultats)
+static _Thread_local struct arena thread_arena;
+
+void *arena_alloc(struct arena *a, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    struct arena_block *b = a->current;
+    struct arena_block *last = b;
+    while (b != NULL && b->used + size > b->size){
+        last = b;
+        b = b->next;
+        if (b != NULL)
+            b->used = 0;
+    }
+    if (b == NULL){
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        b = malloc(ARENA_HEADER + block_size);
+        if (b == NULL)
+            return NULL;
+        b->next = NULL;
+        b->size = block_size;
+        b->used = 0;
+        if (last == NULL){
+            // on peut arriver ici avec current == NULL apres un reset
+            b->next = a->first;
+            a->first = b;
+        }
+        else{
+            b->next = last->next;
+            last->next = b;
+        }
+    }
+    a->current = b;
+    void *r = (char *)b + ARENA_HEADER + b->used;
+    b->used += size;
+    return r;
+}
+
+char *arena_strdup(struct arena *a, const char *str)
+{
+    size_t len = strlen(str);
+    char *r = arena_alloc(a, len + 1);
+    memcpy(r, str, len + 1);
+    return r;
+}
+
+struct arena_mark arena_mark(struct arena *a)
+{
+    struct arena_mark m;
+    m.block = a->current;
+    m.used = a->current ? a->current->used : 0;
+    return m;
+}
+
+void arena_release(struct arena *a, struct arena_mark m)
+{
+    if (m.block == NULL){
+        a->current = a->first;
+        if (a->current != NULL)
+            a->current->used = 0;
+        return;
+    }
+    a->current = m.block;
+    a->current->used = m.used;
+}
+
+void arena_reset(struct arena *a)
+{
+    struct arena_mark m = {NULL, 0};
+    arena_release(a, m);
+}
+
+void arena_free(struct arena *a)
+{
+    struct arena_block *b = a->first;
+    while (b != NULL){
+        struct arena_block *next = b->next;
+        free(b);
+        b = next;
+    }
+    a->first = NULL;
+    a->current = NULL;
+}
+
+// Octets reserves par l'arene (pour les mesures de memoire)
+size_t arena_size(struct arena *a)
+{
+    size_t size = 0;
+    for (struct arena_block *b = a->first; b != NULL; b = b->next)
+        size += b->size;
+    return size;
+}
+
+/*
+    Arene partagee : memoire d'un paquet de lexique commune a plusieurs
+    versions du lexique (voir lexique vivant). Liberee avec sa derniere
+    reference.
+*/
+struct shared_arena {
+    struct arena arena;
+    _Atomic int refs;
+};
+
+struct shared_arena *shared_arena_new(void)
+{
+    struct shared_arena *s = calloc(1, sizeof(struct shared_arena));
+    atomic_init(&s->refs, 1);
+    return s;
+}
+
+struct shared_arena *shared_arena_get(struct shared_arena *s)
+{
+    if (s != NULL)
+        atomic_fetch_add(&s->refs, 1);
+    return s;
+}
+
+void shared_arena_put(struct shared_arena *s)
+{
+    if (s != NULL && atomic_fetch_sub(&s->refs, 1) == 1){
+        arena_free(&s->arena);
+        free(s);
+    }
+}
+
+////////////////////// PARTIE UTF-8 //////////////////////////////////
+
+/*
+    Les mots sont des suites de lettres Unicode (ASCII, Latin-1, Latin
+    etendu A/B, grec, cyrillique) codees en UTF-8. La casse est repliee
+    caractere par caractere ; sur ces plages minuscule et majuscule ont la
+    meme longueur en UTF-8, donc on peut replier sur place.
+*/
+
+// Decode le caractere en s[*i] et avance *i. Un octet invalide est rendu
+// tel quel (comme du Latin-1) pour ne jamais bloquer la lecture.
+unsigned int utf8_decode(const char *s, size_t len, size_t *i)
+{
+    const unsigned char *u = (const unsigned char *)s + *i;
+    size_t left = len - *i;
+    if (u[0] < 0x80) {
+        (*i)++;
+        return u[0];
+    }
+    if ((u[0] & 0xE0) == 0xC0 && left >= 2 && (u[1] & 0xC0) == 0x80) {
+        *i += 2;
+        return ((u[0] & 0x1F) << 6) | (u[1] & 0x3F);
+    }
+    if ((u[0] & 0xF0) == 0xE0 && left >= 3 && (u[1] & 0xC0) == 0x80 && (u[2] & 0xC0) == 0x80) {
+        *i += 3;
+        return ((u[0] & 0x0F) << 12) | ((u[1] & 0x3F) << 6) | (u[2] & 0x3F);
+    }
+    if ((u[0] & 0xF8) == 0xF0 && left >= 4 && (u[1] & 0xC0) == 0x80 && (u[2] & 0xC0) == 0x80 && (u[3] & 0xC0) == 0x80) {
+        *i += 4;
+        return ((u[0] & 0x07) << 18) | ((u[1] & 0x3F) << 12) | ((u[2] & 0x3F) << 6) | (u[3] & 0x3F);
+    }
+    (*i)++;
+    return u[0];
+}
+
+int utf8_encode(unsigned int cp, char *out)
+{
+    if (cp < 0x80) {
+        out[0] = cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = 0xC0 | (cp >> 6);
+        out[1] = 0x80 | (cp & 0x3F);
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = 0xE0 | (cp >> 12);
+        out[1] = 0x80 | ((cp >> 6) & 0x3F);
+        out[2] = 0x80 | (cp & 0x3F);
+        return 3;
+    }
+    out[0] = 0xF0 | (cp >> 18);
+    out[1] = 0x80 | ((cp >> 12) & 0x3F);
+    out[2] = 0x80 | ((cp >> 6) & 0x3F);
+    out[3] = 0x80 | (cp & 0x3F);
+    return 4;
+}
+
+// Nombre de caracteres (et non d'octets) de str
+int utf8_length(const char *str)
+{
+    int length = 0;
+    for (; *str; str++)
+        length += ((unsigned char)*str & 0xC0) != 0x80;
+    return length;
+}
+
+unsigned int fold_codepoint(unsigned int cp)
+{
+    if (cp < 0x80)
+        return ('A' <= cp && cp <= 'Z') ? cp + ('a' - 'A') : cp;
+    if (0xC0 <= cp && cp <= 0xDE && cp != 0xD7)
+        return cp + 0x20;
+    if (cp == 0x178)
+        return 0xFF;
+    if ((0x100 <= cp && cp <= 0x137) || (0x14A <= cp && cp <= 0x177))
+        return cp | 1;
+    if ((0x139 <= cp && cp <= 0x148) || (0x179 <= cp && cp <= 0x17E))
+        return (cp & 1) ? cp + 1 : cp;
+    if (0x391 <= cp && cp <= 0x3AB && cp != 0x3A2)
+        return cp + 0x20;
+    if (0x410 <= cp && cp <= 0x42F)
+        return cp + 0x20;
+    if (0x400 <= cp && cp <= 0x40F)
+        return cp + 0x50;
+    return cp;
+}
+
+unsigned int upper_codepoint(unsigned int cp)
+{
+    if (cp < 0x80)
+        return ('a' <= cp && cp <= 'z') ? cp - ('a' - 'A') : cp;
+    if (0xE0 <= cp && cp <= 0xFE && cp != 0xF7)
+        return cp - 0x20;
+    if (cp == 0xFF)
+        return 0x178;
+    if ((0x100 <= cp && cp <= 0x137) || (0x14A <= cp && cp <= 0x177))
+        return cp & ~1u;
+    if ((0x139 <= cp && cp <= 0x148) || (0x179 <= cp && cp <= 0x17E))
+        return (cp & 1) ? cp : cp - 1;
+    if (0x3B1 <= cp && cp <= 0x3CB && cp != 0x3C2)
+        return cp - 0x20;
+    if (0x430 <= cp && cp <= 0x44F)
+        return cp - 0x20;
+    if (0x450 <= cp && cp <= 0x45F)
+        return cp - 0x50;
+    return cp;
+}
+
+int is_word_codepoint(unsigned int cp)
+{
+    if (cp < 0x80)
+        return ('A' <= cp && cp <= 'Z') || ('a' <= cp && cp <= 'z');
+    if (0xC0 <= cp && cp <= 0x24F)
+        return cp != 0xD7 && cp != 0xF7;
+    return (0x386 <= cp && cp <= 0x3CE) || (0x400 <= cp && cp <= 0x4FF);
+}
+
+// Nombre d'octets du caractere en text[i] s'il fait partie d'un mot, 0 sinon
+size_t utf8_word_char(const char *text, size_t len, size_t i)
+{
+    size_t next = i;
+    unsigned int cp = utf8_decode(text, len, &next);
+    return is_word_codepoint(cp) ? next - i : 0;
+}
+
+int utf8_first_upper(const char *text, size_t len)
+{
+    size_t i = 0;
+    unsigned int cp = utf8_decode(text, len, &i);
+    return fold_codepoint(cp) != cp;
+}
+
+// Copie src[0..n) en minuscules dans dst (n octets + '\0')
+void utf8_fold(char *dst, const char *src, size_t n)
+{
+    size_t i = 0, o = 0;
+    while (i < n) {
+        unsigned int cp = utf8_decode(src, n, &i);
+        o += utf8_encode(fold_codepoint(cp), dst + o);
+    }
+    dst[o] = '\0';
+}
+
+void utf8_upper_first(char *word)
+{
+    size_t i = 0;
+    unsigned int cp = utf8_decode(word, strlen(word), &i);
+    unsigned int up = upper_codepoint(cp);
+    if (up != cp)
+        utf8_encode(up, word);
+}
+
+// Lit un caractere UTF-8 dans file : code point, ou EOF. Les octets lus
+// sont recopies dans bytes (pour reecrire le texte a l'identique).
+int fget_codepoint(FILE *file, char *bytes, int *nb_bytes)
+{
+    int c = fgetc(file);
+    if (c == EOF)
+        return EOF;
+    bytes[0] = c;
+    *nb_bytes = 1;
+    int expected = (c & 0xE0) == 0xC0 ? 2 : (c & 0xF0) == 0xE0 ? 3 : (c & 0xF8) == 0xF0 ? 4 : 1;
+    while (*nb_bytes < expected){
+        c = fgetc(file);
+        if (c == EOF || (c & 0xC0) != 0x80){
+            if (c != EOF)
+                ungetc(c, file);
+            *nb_bytes = 1;
+            return (unsigned char)bytes[0];
+        }
+        bytes[(*nb_bytes)++] = c;
+    }
+    size_t i = 0;
+    return utf8_decode(bytes, *nb_bytes, &i);
+}
 
 ////////////////////// PARTIE LEVENSHTEIN ////////////////////////////
 
@@ -14,8 +380,8 @@ typedef enum {
 struct edit {
     unsigned int score;
     edit_type type;
-    char arg1;
-    char arg2;
+    unsigned int arg1;      // code points
+    unsigned int arg2;
     unsigned int pos;
     struct edit *prev;
 };
@@ -23,160 +389,379 @@ typedef struct edit edit;
  
 static int min3(int a, int b, int c)
 {
-    if (a < b && a < c) {
+    if (a <= b && a <= c) {
         return a;
     }
-    if (b < a && b < c) {
+    if (b <= c) {
         return b;
     }
     return c;
 }
  
-static unsigned int levenshtein_matrix_calculate(edit **mat, const char *str1, size_t len1, const char *str2, size_t len2)
-{
-    unsigned int i, j;
-    for (j = 1; j <= len2; j++) {
-        for (i = 1; i <= len1; i++) {
-            unsigned int substitution_cost;
-            unsigned int del = 0, ins = 0, subst = 0;
-            unsigned int best;
-            if (str1[i - 1] == str2[j - 1]) {
-                substitution_cost = 0;
-            }
-            else {
-                substitution_cost = 1;
-            }
-            del = mat[i - 1][j].score + 1; /* deletion */
-            ins = mat[i][j - 1].score + 1; /* insertion */
-            subst = mat[i - 1][j - 1].score + substitution_cost; /* substitution */
-            best = min3(del, ins, subst);
-            mat[i][j].score = best;                  
-            mat[i][j].arg1 = str1[i - 1];
-            mat[i][j].arg2 = str2[j - 1];
-            mat[i][j].pos = i - 1;
-            if (best == del) {
-                mat[i][j].type = DELETION;
-                mat[i][j].prev = &mat[i - 1][j];
-            }
-            else if (best == ins) {
-                mat[i][j].type = INSERTION;
-                mat[i][j].prev = &mat[i][j - 1];
-            }
-            else {
-                if (substitution_cost > 0) {
-                    mat[i][j].type = SUBSTITUTION;
-                }
-                else {
-                    mat[i][j].type = NONE;
-                }
-                mat[i][j].prev = &mat[i - 1][j - 1];
-            }
+static inline unsigned int min_branchless(unsigned int a, unsigned int b)
+{
+    return b ^ ((a ^ b) & -(unsigned int)(a < b));
+}
+
+/*
+    Distance sur une seule ligne de scores. Deux noyaux : un sur les octets
+    pour les mots ASCII (le cas courant, sans branchement dans la boucle),
+    un sur les code points pour les mots accentues.
+*/
+#define LEVENSHTEIN_STACK_ROW 128
+
+static unsigned int levenshtein_ascii(const char *str1, size_t len1, const char *str2, size_t len2)
+{
+    unsigned int stack_row[LEVENSHTEIN_STACK_ROW];
+    unsigned int *row = stack_row;
+    struct arena_mark mark = arena_mark(&thread_arena);
+    size_t i, j;
+    if (len2 >= LEVENSHTEIN_STACK_ROW)
+        row = arena_alloc(&thread_arena, (len2 + 1) * sizeof(unsigned int));
+    for (j = 0; j <= len2; j++)
+        row[j] = j;
+    for (i = 1; i <= len1; i++) {
+        unsigned int diag = row[0];
+        char c1 = str1[i - 1];
+        row[0] = i;
+        for (j = 1; j <= len2; j++) {
+            unsigned int up = row[j];
+            unsigned int best = min_branchless(up, row[j - 1]) + 1;
+            row[j] = min_branchless(best, diag + (c1 != str2[j - 1]));
+            diag = up;
         }
     }
-    return mat[len1][len2].score;
+    unsigned int distance = row[len2];
+    arena_release(&thread_arena, mark);
+    return distance;
 }
- 
-static edit **levenshtein_matrix_create(size_t len1, size_t len2)
+
+static unsigned int levenshtein_codepoints(const unsigned int *str1, size_t len1, const unsigned int *str2, size_t len2)
 {
-    unsigned int i, j;
-    edit **mat = malloc((len1 + 1) * sizeof(edit *));
-    if (mat == NULL) {
-        return NULL;
-    }
-    for (i = 0; i <= len1; i++) {
-        mat[i] = malloc((len2 + 1) * sizeof(edit));
-        if (mat[i] == NULL) {
-            for (j = 0; j < i; j++) {
-                free(mat[j]);
-            }
-            free(mat);
-            return NULL;
+    unsigned int stack_row[LEVENSHTEIN_STACK_ROW];
+    unsigned int *row = stack_row;
+    struct arena_mark mark = arena_mark(&thread_arena);
+    size_t i, j;
+    if (len2 >= LEVENSHTEIN_STACK_ROW)
+        row = arena_alloc(&thread_arena, (len2 + 1) * sizeof(unsigned int));
+    for (j = 0; j <= len2; j++)
+        row[j] = j;
+    for (i = 1; i <= len1; i++) {
+        unsigned int diag = row[0];
+        row[0] = i;
+        for (j = 1; j <= len2; j++) {
+            unsigned int up = row[j];
+            row[j] = min3(up + 1, row[j - 1] + 1, diag + (str1[i - 1] != str2[j - 1]));
+            diag = up;
         }
     }
-    for (i = 0; i <= len1; i++) {
-        mat[i][0].score = i;
-        mat[i][0].prev = NULL;
-        mat[i][0].arg1 = 0;
-        mat[i][0].arg2 = 0;
+    unsigned int distance = row[len2];
+    arena_release(&thread_arena, mark);
+    return distance;
+}
+
+/*
+    Noyaux specialises par longueur : presque toutes les comparaisons se font
+    entre mots de 3 a 20 lettres, et les deux longueurs sont connues avant le
+    parcours d'un paquet. Pour chaque couple (longueur du mot du dictionnaire,
+    longueur du mot OCR) on genere une fonction dont les boucles ont des bornes
+    constantes, deroulees entierement, avec la ligne de scores sur la pile.
+    levenshtein_distance passe par la table lev_kernels ; en dehors de
+    LEV_MIN..LEV_MAX on garde levenshtein_ascii.
+*/
+#define LEV_MIN 3
+#define LEV_MAX 20
+
+#define LEV_KERNEL(M, N) \
+static unsigned int lev_kernel_##M##_##N(const char *str1, const char *str2) \
+{ \
+    unsigned int row[N + 1]; \
+    int i, j; \
+    _Pragma("GCC unroll 32") \
+    for (j = 0; j <= N; j++) \
+        row[j] = j; \
+    for (i = 1; i <= M; i++) { \
+        unsigned int diag = row[0]; \
+        char c1 = str1[i - 1]; \
+        row[0] = i; \
+        _Pragma("GCC unroll 32") \
+        for (j = 1; j <= N; j++) { \
+            unsigned int up = row[j]; \
+            unsigned int best = min_branchless(up, row[j - 1]) + 1; \
+            row[j] = min_branchless(best, diag + (c1 != str2[j - 1])); \
+            diag = up; \
+        } \
+    } \
+    return row[N]; \
+}
+
+#define LEV_LENGTHS(X, M) X(M, 3) X(M, 4) X(M, 5) X(M, 6) X(M, 7) X(M, 8) X(M, 9) X(M, 10) X(M, 11) X(M, 12) X(M, 13) X(M, 14) X(M, 15) X(M, 16) X(M, 17) X(M, 18) X(M, 19) X(M, 20)
+#define LEV_ROWS(X) X(3) X(4) X(5) X(6) X(7) X(8) X(9) X(10) X(11) X(12) X(13) X(14) X(15) X(16) X(17) X(18) X(19) X(20)
+
+#define LEV_ROW_KERNELS(M) LEV_LENGTHS(LEV_KERNEL, M)
+LEV_ROWS(LEV_ROW_KERNELS)
+
+#define LEV_ENTRY(M, N) [M][N] = lev_kernel_##M##_##N,
+#define LEV_ROW_ENTRIES(M) LEV_LENGTHS(LEV_ENTRY, M)
+
+typedef unsigned int (*lev_kernel)(const char *, const char *);
+
+static const lev_kernel lev_kernels[LEV_MAX + 1][LEV_MAX + 1] = {
+    LEV_ROWS(LEV_ROW_ENTRIES)
+};
+
+static size_t utf8_to_codepoints(const char *str, size_t len, unsigned int *out)
+{
+    size_t i = 0, n = 0;
+    while (i < len)
+        out[n++] = utf8_decode(str, len, &i);
+    return n;
+}
+
+// Distance en caracteres (code points), pas en octets
+unsigned int levenshtein_distance(const char *str1, const char *str2)
+{
+    size_t len1 = 0, len2 = 0;
+    unsigned char high = 0;
+    while (str1[len1])
+        high |= (unsigned char)str1[len1++];
+    while (str2[len2])
+        high |= (unsigned char)str2[len2++];
+    if (!(high & 0x80)) {
+        if (len1 >= LEV_MIN && len1 <= LEV_MAX && len2 >= LEV_MIN && len2 <= LEV_MAX)
+            return lev_kernels[len1][len2](str1, str2);
+        return levenshtein_ascii(str1, len1, str2, len2);
     }
- 
-    for (j = 0; j <= len2; j++) {
-        mat[0][j].score = j;
-        mat[0][j].prev = NULL;
-        mat[0][j].arg1 = 0;
-        mat[0][j].arg2 = 0;
+
+    struct arena_mark mark = arena_mark(&thread_arena);
+    unsigned int *cp1 = arena_alloc(&thread_arena, (len1 + 1) * sizeof(unsigned int));
+    unsigned int *cp2 = arena_alloc(&thread_arena, (len2 + 1) * sizeof(unsigned int));
+    len1 = utf8_to_codepoints(str1, len1, cp1);
+    len2 = utf8_to_codepoints(str2, len2, cp2);
+    unsigned int distance = levenshtein_codepoints(cp1, len1, cp2, len2);
+    arena_release(&thread_arena, mark);
+    return distance;
+}
+
+/*
+    Explication d'une correction : liste des insertions / suppressions /
+    substitutions pour passer du mot OCR au mot corrige.
+    Au lieu de la matrice de struct edit (24 octets et un pointeur par case),
+    on garde une seule ligne de scores et la direction de chaque case sur
+    2 bits dans un buffer contigu. Au dela de EXPLAIN_TABLE_CELLS cases, on
+    passe a Hirschberg : memoire lineaire, en decoupant le probleme en deux
+    autour de la ligne du milieu.
+*/
+
+#define EXPLAIN_TABLE_CELLS 65536
+
+enum { DIR_MATCH = 0, DIR_SUBST = 1, DIR_DEL = 2, DIR_INS = 3 };
+
+struct edit_op {
+    unsigned char type;     // edit_type
+    unsigned int arg1;      // code point du mot OCR
+    unsigned int arg2;      // code point du mot corrige
+    unsigned int pos;       // position dans le mot OCR, en caracteres
+};
+
+static void explain_push(struct edit_op *ops, unsigned int *nb_ops, edit_type type, unsigned int arg1, unsigned int arg2, unsigned int pos)
+{
+    ops[*nb_ops].type = type;
+    ops[*nb_ops].arg1 = arg1;
+    ops[*nb_ops].arg2 = arg2;
+    ops[*nb_ops].pos = pos;
+    (*nb_ops)++;
+}
+
+// Derniere ligne des scores de str1 contre les prefixes de str2, en espace
+// lineaire. reverse : les deux chaines sont lues a l'envers.
+static void explain_last_row(const unsigned int *str1, size_t len1, const unsigned int *str2, size_t len2, int reverse, unsigned int *row)
+{
+    size_t i, j;
+    for (j = 0; j <= len2; j++)
+        row[j] = j;
+    for (i = 1; i <= len1; i++) {
+        unsigned int diag = row[0];
+        unsigned int c1 = reverse ? str1[len1 - i] : str1[i - 1];
+        row[0] = i;
+        for (j = 1; j <= len2; j++) {
+            unsigned int c2 = reverse ? str2[len2 - j] : str2[j - 1];
+            unsigned int up = row[j];
+            row[j] = min3(up + 1, row[j - 1] + 1, diag + (c1 != c2));
+            diag = up;
+        }
     }
-    return mat; 
 }
 
+// Table de directions 2 bits par case, puis remontee depuis (len1, len2)
+static void explain_table(const unsigned int *str1, size_t len1, const unsigned int *str2, size_t len2, unsigned int pos, struct edit_op *ops, unsigned int *nb_ops)
+{
+    struct arena_mark mark = arena_mark(&thread_arena);
+    size_t width = len2 + 1;
+    unsigned char *dirs = arena_alloc(&thread_arena, ((len1 + 1) * width + 3) / 4);
+    unsigned int *row = arena_alloc(&thread_arena, width * sizeof(unsigned int));
+    size_t i, j;
+    memset(dirs, 0, ((len1 + 1) * width + 3) / 4);
+#define DIR_SET(i, j, d) (dirs[((i) * width + (j)) >> 2] |= (unsigned char)((d) << ((((i) * width + (j)) & 3) * 2)))
+#define DIR_GET(i, j) ((dirs[((i) * width + (j)) >> 2] >> ((((i) * width + (j)) & 3) * 2)) & 3)
+    for (j = 0; j <= len2; j++) {
+        row[j] = j;
+        DIR_SET(0, j, DIR_INS);
+    }
+    for (i = 1; i <= len1; i++) {
+        unsigned int diag = row[0];
+        row[0] = i;
+        DIR_SET(i, 0, DIR_DEL);
+        for (j = 1; j <= len2; j++) {
+            unsigned int up = row[j];
+            unsigned int del = up + 1, ins = row[j - 1] + 1;
+            unsigned int subst = diag + (str1[i - 1] != str2[j - 1]);
+            unsigned int best = min3(del, ins, subst);
+            // meme ordre de preference que levenshtein_matrix_calculate
+            if (best == del)
+                DIR_SET(i, j, DIR_DEL);
+            else if (best == ins)
+                DIR_SET(i, j, DIR_INS);
+            else if (str1[i - 1] != str2[j - 1])
+                DIR_SET(i, j, DIR_SUBST);
+            row[j] = best;
+            diag = up;
+        }
+    }
+    // remontee : les operations sortent a l'envers, on les retourne ensuite
+    unsigned int first = *nb_ops;
+    i = len1;
+    j = len2;
+    while (i > 0 || j > 0) {
+        int d = DIR_GET(i, j);
+        if (d == DIR_DEL) {
+            explain_push(ops, nb_ops, DELETION, str1[i - 1], 0, pos + i - 1);
+            i--;
+        }
+        else if (d == DIR_INS) {
+            explain_push(ops, nb_ops, INSERTION, 0, str2[j - 1], pos + i);
+            j--;
+        }
+        else {
+            if (d == DIR_SUBST)
+                explain_push(ops, nb_ops, SUBSTITUTION, str1[i - 1], str2[j - 1], pos + i - 1);
+            i--;
+            j--;
+        }
+    }
+#undef DIR_SET
+#undef DIR_GET
+    for (unsigned int a = first, b = *nb_ops; a + 1 < b; a++, b--) {
+        struct edit_op t = ops[a];
+        ops[a] = ops[b - 1];
+        ops[b - 1] = t;
+    }
+    arena_release(&thread_arena, mark);
+}
 
-unsigned int levenshtein_distanc(const char *str1,const char *str2, edit **script)
+static void explain_hirschberg(const unsigned int *str1, size_t len1, const unsigned int *str2, size_t len2, unsigned int pos, struct edit_op *ops, unsigned int *nb_ops)
 {
-    const size_t len1 = strlen(str1), len2 = strlen(str2);
-    unsigned int i, distance;
-    edit **mat, *head;
- 
-    /* If either string is empty, the distance is the other string's length */
+    size_t j;
     if (len1 == 0) {
-        return len2;
+        for (j = 0; j < len2; j++)
+            explain_push(ops, nb_ops, INSERTION, 0, str2[j], pos);
+        return;
     }
     if (len2 == 0) {
-        return len1;
+        for (j = 0; j < len1; j++)
+            explain_push(ops, nb_ops, DELETION, str1[j], 0, pos + j);
+        return;
     }
-    /* Initialise the matrix */
-    mat = levenshtein_matrix_create(len1, len2);
-    if (!mat) {
-        *script = NULL;
-        return 0;
+    if ((len1 + 1) * (len2 + 1) <= EXPLAIN_TABLE_CELLS || len1 == 1) {
+        explain_table(str1, len1, str2, len2, pos, ops, nb_ops);
+        return;
+    }
+    struct arena_mark mark = arena_mark(&thread_arena);
+    size_t mid = len1 / 2, split = 0;
+    unsigned int *forward = arena_alloc(&thread_arena, (len2 + 1) * sizeof(unsigned int));
+    unsigned int *backward = arena_alloc(&thread_arena, (len2 + 1) * sizeof(unsigned int));
+    explain_last_row(str1, mid, str2, len2, 0, forward);
+    explain_last_row(str1 + mid, len1 - mid, str2, len2, 1, backward);
+    unsigned int best = (unsigned int)-1;
+    for (j = 0; j <= len2; j++) {
+        if (forward[j] + backward[len2 - j] < best) {
+            best = forward[j] + backward[len2 - j];
+            split = j;
+        }
     }
-    /* Main algorithm */
-    distance = levenshtein_matrix_calculate(mat, str1, len1, str2, len2);
-    /* Read back the edit script */
-    *script = malloc(distance * sizeof(edit));
+    arena_release(&thread_arena, mark);
+    explain_hirschberg(str1, mid, str2, split, pos, ops, nb_ops);
+    explain_hirschberg(str1 + mid, len1 - mid, str2 + split, len2 - split, pos + mid, ops, nb_ops);
+}
+
+// Operations pour passer de ocr_word a corrected, dans l'ordre du mot.
+// *ops est dans thread_arena ; renvoie la distance (= nombre d'operations).
+unsigned int explain_correction(const char *ocr_word, const char *corrected, struct edit_op **ops)
+{
+    size_t len1 = strlen(ocr_word), len2 = strlen(corrected);
+    unsigned int nb_ops = 0;
+    *ops = arena_alloc(&thread_arena, (len1 + len2 + 1) * sizeof(struct edit_op));
+    // les operations sont en caracteres, comme levenshtein_distance
+    struct arena_mark mark = arena_mark(&thread_arena);
+    unsigned int *cp1 = arena_alloc(&thread_arena, (len1 + 1) * sizeof(unsigned int));
+    unsigned int *cp2 = arena_alloc(&thread_arena, (len2 + 1) * sizeof(unsigned int));
+    len1 = utf8_to_codepoints(ocr_word, len1, cp1);
+    len2 = utf8_to_codepoints(corrected, len2, cp2);
+    explain_hirschberg(cp1, len1, cp2, len2, 0, *ops, &nb_ops);
+    arena_release(&thread_arena, mark);
+    return nb_ops;
+}
+
+// Ancienne interface : script en struct edit (free malloc)
+unsigned int levenshtein_distanc(const char *str1,const char *str2, edit **script)
+{
+    struct arena_mark mark = arena_mark(&thread_arena);
+    struct edit_op *ops;
+    unsigned int i, distance = explain_correction(str1, str2, &ops);
+    *script = malloc((distance + 1) * sizeof(edit));
     if (*script) {
-        i = distance - 1;
-        for (head = &mat[len1][len2];
-                head->prev != NULL;
-                head = head->prev) {
-            if (head->type != NONE) {
-                memcpy(*script + i, head, sizeof(edit));
-                i--;
-            }
+        for (i = 0; i < distance; i++) {
+            (*script)[i].score = i + 1;
+            (*script)[i].type = ops[i].type;
+            (*script)[i].arg1 = ops[i].arg1;
+            (*script)[i].arg2 = ops[i].arg2;
+            (*script)[i].pos = ops[i].pos;
+            (*script)[i].prev = i > 0 ? &(*script)[i - 1] : NULL;
         }
     }
     else {
         distance = 0;
     }
-    /* Clean up */
-    for (i = 0; i <= len1; i++) {
-        free(mat[i]);
-    }
-    free(mat);
- 
+    arena_release(&thread_arena, mark);
     return distance;
 }
 
-unsigned int levenshtein_distance(const char *str1, const char *str2)
+static void print_edit(edit_type type, unsigned int arg1, unsigned int arg2, unsigned int pos)
 {
-    edit *script;
-    unsigned int distance = levenshtein_distanc(str1, str2, &script);
-    free(script);
-    return distance;
+    char c1[5], c2[5];
+    c1[utf8_encode(arg1, c1)] = '\0';
+    c2[utf8_encode(arg2, c2)] = '\0';
+    if (type == INSERTION) {
+        printf("Insert %s", c2);
+    }
+    else if (type == DELETION) {
+        printf("Delete %s", c1);
+    }
+    else {
+        printf("Substitute %s for %s", c2, c1);
+    }
+    printf(" at %u\n", pos);
+}
+
+void print_edit_op(struct edit_op *e)
+{
+    print_edit(e->type, e->arg1, e->arg2, e->pos);
 }
 
 
 void print(edit *e)
 {
-    if (e->type == INSERTION) {
-        printf("Insert %c", e->arg2);
-    }
-    else if (e->type == DELETION) {
-        printf("Delete %c", e->arg1);
-    }
-    else {
-        printf("Substitute %c for %c", e->arg2, e->arg1);
-    }
-    printf(" at %u\n", e->pos);
+    print_edit(e->type, e->arg1, e->arg2, e->pos);
 }
 
 //////////////////////// MAIN LEVENSHTEIN///////////////////////////////
@@ -205,33 +790,36 @@ int convert_str_int(char* str)
 }
 
 
-char* convert_length_filename(int length) // free malloc
+char* convert_prefix_length_filename(const char* str_start, int length) // thread_arena
 {
     int nb_l = 1;
     if (length > 9){
         nb_l++;
     }
-    char *str_nb = malloc (sizeof (char) * nb_l);
+    char str_nb[3];
     for (int h = nb_l-1; h >= 0; h--)
     {
         str_nb[h] = (char)('0' + length % 10);
         length = length / 10;
     }
     str_nb[nb_l] = '\0';
-    char * str_start = "dictionary_eng/length_";
     int l_start = strlen(str_start);
     char * str_ext = ".txt";
     int l_ext = strlen(str_ext);
     int length_filename = l_start + nb_l + l_ext; // "dictionary/length_" + [nb] + ".txt"
-    char *filename = malloc (sizeof (char) * length_filename);
+    char *filename = arena_alloc(&thread_arena, sizeof (char) * (length_filename + 1));
     strcpy(filename, str_start);
     strcat(filename, str_nb);
-    free(str_nb);
     strcat(filename, str_ext);
     
     return filename;
 }
 
+char* convert_length_filename(int length) // thread_arena
+{
+    return convert_prefix_length_filename("dictionary_eng/length_", length);
+}
+
 char* convert_filenameocr_filenamedupli(const char* filenameocr) // free malloc
 {
     char *start_dupli = ".";
@@ -256,24 +844,30 @@ char* convert_filenameocr_filenameref(const char* filenameocr) // free malloc
     return filename_ref;
 }
 
-char *next_word(FILE* file, int length, int *finished) // free malloc
+char *next_word(FILE* file, int length, int *finished) // thread_arena
 {
-    char* word = malloc(sizeof (char) * length);
+    // une ligne du dictionnaire : length caracteres de 1 a 4 octets
+    int cap = 4 * length;
+    char* word = arena_alloc(&thread_arena, sizeof (char) * (cap + 1));
     int i = 0;
     int int_charr = fgetc(file);
-    if (int_charr == EOF)
-        *finished = 1;
-    while (int_charr != EOF && int_charr != '\n' && i<length)
+    while (int_charr != EOF && int_charr != '\n')
     {
-        word[i] = int_charr;
+        if (int_charr != '\r' && i < cap){
+            word[i] = int_charr;
+            i++;
+        }
         int_charr = fgetc(file);
-        i++;
     }
     word[i] = '\0';
+    if (int_charr != EOF){
+        int_charr = fgetc(file);
+        if (int_charr != EOF)
+            ungetc(int_charr, file);
+    }
     if (int_charr == EOF){
         *finished = 1;
     }
-    //fgetc(file);
     return word;
 }
 
@@ -290,40 +884,39 @@ int compare(char* ocr_word, char* file_word)
     return r;
 }
 
+/*
+    Les recherches de mots passent par le lexique en memoire (PARTIE
+    LEXIQUE) : le dictionnaire est lu une fois, et un token ne coute plus ni
+    fopen ni tampon stdio.
+*/
+struct lexicon;
+struct lexicon *default_lexicon(void);
+int lexicon_exist(struct lexicon *lex, const char *word);
+char* lexicon_correction(struct lexicon *lex, char* ocr_word, int nb, int plus);
+int lexicon_nb_solutions(struct lexicon *lex, char* word, int plus);
+struct junk_stats;
+static int junk_count(struct lexicon *lex, const char *word, struct junk_stats *stats); // 0 : JUNK_NONE
+
 int exist_eng(char* ocr_word)
 {
-    int l_word = strlen(ocr_word);
+    int l_word = utf8_length(ocr_word);
     if (l_word < 3)
         return 0;
-    char* filename = convert_length_filename(l_word);
-    FILE* file = fopen(filename,"r");
-
-    int finish = 0;
-    int *pf = &finish;
-
-
-    while (*pf != 1){
-        char* word_file = next_word(file, l_word, pf);
-        char end = fgetc(file);
-        if (end == EOF)
-            *pf = 1;
-        unsigned int distance = levenshtein_distance(word_file, ocr_word);
-        free(word_file);
-        if (distance == 0)
-            return 1;
-    }
-    fclose(file);
-    free(filename);
-    return 2;
+    struct lexicon *lex = default_lexicon();
+    if (lex == NULL)
+        return 2;
+    return lexicon_exist(lex, ocr_word);
 }
 
 int __save_correction(char* ocr_word, int nb)
 {
-    int l_word = strlen(ocr_word);
+    int l_word = utf8_length(ocr_word);
     if (l_word < 3)
         return 0;
     printf("l_word : %i\n",l_word);
+    struct arena_mark mark = arena_mark(&thread_arena);
     char* filename = convert_length_filename(l_word);
+    struct arena_mark word_mark = arena_mark(&thread_arena);
     printf("filename : %s\n", filename);
     FILE* file = fopen(filename,"r");
 
@@ -331,15 +924,12 @@ int __save_correction(char* ocr_word, int nb)
     int *pf = &finish;
 
     unsigned int min_dist = 50;
-    char sk_word[l_word];
+    char sk_word[4 * l_word + 1];
 
     int nbb = nb;
 
     while (*pf != 1){
         char* word_file = next_word(file, l_word, pf);
-        char end = fgetc(file);
-        if (end == EOF)
-            *pf = 1;
         unsigned int distance = levenshtein_distance(word_file, ocr_word);
         printf("%s, %u\n", word_file, distance);
         if (distance == min_dist && nbb>0){
@@ -354,7 +944,7 @@ int __save_correction(char* ocr_word, int nb)
             strcpy(sk_word, word_file);
         }
 
-        free(word_file);
+        arena_release(&thread_arena, word_mark);
     }
     printf("check1\n");
     //strcpy(correction, sk_word);
@@ -371,92 +961,42 @@ int __save_correction(char* ocr_word, int nb)
     printf("min_dist : %u\n", min_dist);
 
     fclose(file);
-    free(filename);
-    //free(word_file);
+    arena_release(&thread_arena, mark);
     int r = compare(ocr_word, sk_word);
     return r;
 }
 
-char* correction(char* ocr_word, int nb, int plus) // free malloc
+char* correction(char* ocr_word, int nb, int plus) // thread_arena
 {
-    int l_word = strlen(ocr_word);
-    if (l_word < 3){
-        char *r = malloc(sizeof(char) * l_word);
-        strcpy(r, ocr_word);
-        return r;
-    }
-
-    l_word +=plus;
-    char* filename = convert_length_filename(l_word);
-    FILE* file = fopen(filename,"r");
+    struct lexicon *lex = default_lexicon();
+    if (lex == NULL)
+        return arena_strdup(&thread_arena, ocr_word);
+    return lexicon_correction(lex, ocr_word, nb, plus);
+}
 
-    int finish = 0;
-    int *pf = &finish;
+int count_word(char *filename)
+{
+    FILE *file = fopen(filename,"r");
+    char bytes[4];
+    int nb_bytes;
 
-    unsigned int min_dist = 50;
-    char sk_word[l_word];
+    int in_word = 0;
+    int count = 0;
 
-    int nbb = nb;
-
-    while (*pf != 1){
-        char* word_file = next_word(file, l_word, pf);
-        char end = fgetc(file);
-        if (end == EOF)
-            *pf = 1;
-        unsigned int distance = levenshtein_distance(word_file, ocr_word);
-        //printf("%s, %u\n", word_file, distance);
-        if (distance == min_dist && nbb>0){
-            nbb--;
-            strcpy(sk_word,word_file);
-        }
-        if (distance < min_dist){
-            min_dist = distance;
-            //sk_word = word_file;
-            //printf("check5\n");
-            nbb = nb;
-            strcpy(sk_word, word_file);
-        }
-
-        free(word_file);
-    }
-    char *r = malloc(sizeof(char)*l_word);
-    strcpy(r, sk_word);
-    //printf("\nsk_word : %s\n", r);
-    //printf("min_dist : %u\n", min_dist);
-
-    fclose(file);
-    free(filename);
-
-    return r;
-}
-
-int count_word(char *filename)
-{
-    FILE *file = fopen(filename,"r");
-    int finish = 0;
-    int *pf = &finish;
-
-    int in_word = 0;
-    int count = 0;
-
-    char charr = fgetc(file);
-    if (charr == EOF)
-        return 0;
-    while (*pf != 1)
+    int charr = fget_codepoint(file, bytes, &nb_bytes);
+    while (charr != EOF)
     {
-        if ((('a' <= charr && charr <= 'z') || ('A' <= charr && charr <= 'Z')) && in_word == 0){
+        if (is_word_codepoint(charr) && in_word == 0){
             in_word = 1;
             count++;
         }
         else{
-            if (!('a' <= charr && charr <= 'z') && !('A' <= charr && charr <= 'Z') && in_word == 1){
+            if (!is_word_codepoint(charr) && in_word == 1){
                 in_word = 0;
             }
         }
 
-        charr = fgetc(file);
-        if (charr == EOF)
-            *pf = 1;
+        charr = fget_codepoint(file, bytes, &nb_bytes);
     }
 
     fclose(file);
@@ -466,113 +1006,63 @@ int count_word(char *filename)
 
 void initialise(char *filename)
 {
-    printf("check1\n");
     FILE* ocr = fopen(filename, "r");
-    char *filename_dupli = ".";
-    char *filename_ref = ".ref_";
+    char *start_dupli = ".";
+    char *start_ref = ".ref_";
     char *twotxt = "2.txt";
-    printf("check2\n");
+    char filename_dupli[strlen(start_dupli) + strlen(filename) + strlen(twotxt) + 1];
+    char filename_ref[strlen(start_ref) + strlen(filename) + strlen(twotxt) + 1];
+    strcpy(filename_dupli, start_dupli);
     strcat(filename_dupli,filename);
-    printf("check3\n");
     strcat(filename_dupli,twotxt);
-    printf("check4\n");
+    strcpy(filename_ref, start_ref);
     strcat(filename_ref,filename);
-    printf("check5\n");
     strcat(filename_ref,twotxt);
 
-    printf("check6\n");
     FILE* dupli = fopen(filename_dupli,"a");
     FILE* ref = fopen(filename_ref,"a");
 
-    char charr = fgetc(ocr);
-    char *str = "";
+    char bytes[4];
+    int nb_bytes;
+    int length_max = 200;
+    char str[length_max];
+    int l_str = 0;
+    int charr = fget_codepoint(ocr, bytes, &nb_bytes);
     while (charr != EOF){
-        char *temp = malloc(sizeof(char) * 1);
-        temp[0] = charr;
-        fputs(temp, dupli);
-        free(temp);
-        if ((('a' <= charr && charr <= 'z') || ('A' <= charr && charr <= 'Z'))){
-            char *temp = malloc(sizeof(char) * 1);
-            temp[0] = charr;
-            strcat(str, temp);
-            free(temp);
+        fwrite(bytes, 1, nb_bytes, dupli);
+        if (is_word_codepoint(charr)){
+            if (l_str < length_max - 5)
+                l_str += utf8_encode(fold_codepoint(charr), str + l_str);
         }
         else{
-            if (strcmp("", str) != 0){
-                char *temp = malloc(sizeof(char)*2);
-                int index = exist_eng(str);
-                temp[0] = '0' + index/10;
-                temp[1] = '0' + index%10;
-                fputs(temp,ref);
-                free(temp);
-                fputs(" ",ref);
-                str = "";
+            if (l_str != 0){
+                str[l_str] = '\0';
+                fprintf(ref, "%02d ", exist_eng(str));
+                l_str = 0;
             }
         }
         
-        charr = fgetc(ocr);
+        charr = fget_codepoint(ocr, bytes, &nb_bytes);
     }
 
-    if (strcmp("", str) != 0){
-        char *temp = malloc(sizeof(char)*2);
-        int index = exist_eng(str);
-        temp[0] = '0' + index/10;
-        temp[1] = '0' + index%10;
-        fputs(temp,ref);
-        free(temp);
-        fputs(" ",ref);
+    if (l_str != 0){
+        str[l_str] = '\0';
+        fprintf(ref, "%02d ", exist_eng(str));
     }
 
 
     // nav OCR file
     fclose(ocr);
+    fclose(dupli);
+    fclose(ref);
 }
 
 int nb_solutions(char* word, int plus)
 {
-    int l_word = strlen(word);
-    if (l_word < 3){
+    struct lexicon *lex = default_lexicon();
+    if (lex == NULL)
         return 0;
-    }
-
-    l_word +=plus;
-    char* filename = convert_length_filename(l_word);
-    FILE* file = fopen(filename,"r");
-
-    int finish = 0;
-    int *pf = &finish;
-
-    int nb = 0;
-
-    unsigned int min_dist = 50;
-    char sk_word[l_word];
-
-    while (*pf != 1){
-        char* word_file = next_word(file, l_word, pf);
-        char end = fgetc(file);
-        if (end == EOF)
-            *pf = 1;
-        unsigned int distance = levenshtein_distance(word_file, word);
-        //printf("%s, %u\n", word_file, distance);
-        if (distance == min_dist){
-            nb++;
-            strcpy(sk_word,word_file);
-        }
-        if (distance < min_dist){
-            min_dist = distance;
-            //sk_word = word_file;
-            //printf("check5\n");
-            nb = 1;
-            strcpy(sk_word, word_file);
-        }
-
-        free(word_file);
-    }
-
-    fclose(file);
-    free(filename);
-
-    return nb;
+    return lexicon_nb_solutions(lex, word, plus);
 }
 
 void correction_solutions(char* word, int var_avant, int var_apres)
@@ -596,9 +1086,10 @@ void correction_solutions(char* word, int var_avant, int var_apres)
         while (j < var_apres +1){//2
             i = 0;
             while (i < nb){
+                struct arena_mark mark = arena_mark(&thread_arena);
                 char* r = correction(word , i, j);
                 printf("%s\n", r);
-                free(r);
+                arena_release(&thread_arena, mark);
                 i++;
             }
             j++;
@@ -618,13 +1109,15 @@ char* first_solution(char* word)
 }
 
 
-void first_file(char* filename){
-    int length_max = 50;
+// Les mots inconnus passent par le filtre des dechets avant la recherche ;
+// junk (si non NULL) recoit les rejets.
+void first_file_junk(char* filename, struct junk_stats *junk){
+    int length_max = 200;
     int l_filename = strlen(filename);
     char* start = "c_";
     int l_start = strlen(start);
     int l_filename_dupli = l_start + l_filename;
-    char* filename_dupli = malloc(sizeof(char) * l_filename_dupli);
+    char* filename_dupli = malloc(sizeof(char) * (l_filename_dupli + 1));
     strcpy(filename_dupli, start);
     strcat(filename_dupli, filename);
     filename_dupli[l_filename_dupli] = '\0';
@@ -633,80 +1126,55 @@ void first_file(char* filename){
 
     int first_maj = 0;
     int index = 0;
+    char bytes[4];
+    int nb_bytes;
     
-    int int_charr = fgetc(file);
-    if ('A' <= int_charr && int_charr <= 'Z'){
-        int_charr += 'a' - 'A';
-        first_maj = 1;
-    }
-    while (int_charr != EOF)
+    int charr = fget_codepoint(file, bytes, &nb_bytes);
+    while (charr != EOF)
     {
-        while (int_charr != EOF && !('A' <= int_charr && int_charr <= 'Z')&& !('a' <= int_charr && int_charr <= 'z'))
+        while (charr != EOF && !is_word_codepoint(charr))
         {
-            // insertion fichier int_charr
-            char* one_char = malloc(sizeof(char)*1);
-            one_char[0] = int_charr;
-            one_char[1] = '\0';
-            fputs(one_char, file_dupli);
-            //printf("\'%c\' ",int_charr);
-            free(one_char);
-            int_charr = fgetc(file);
+            // insertion fichier charr, octets d'origine
+            fwrite(bytes, 1, nb_bytes, file_dupli);
+            charr = fget_codepoint(file, bytes, &nb_bytes);
         }
-        if (int_charr != EOF)
+        if (charr != EOF)
         {
-            char* word = malloc(sizeof (char) * length_max);
+            // tout ce qui est alloue pour ce token est rendu d'un coup a la fin
+            struct arena_mark mark = arena_mark(&thread_arena);
+            char* word = arena_alloc(&thread_arena, sizeof (char) * length_max);
             int i = 0;
+            first_maj = fold_codepoint(charr) != (unsigned int)charr;
             
-            while (int_charr != EOF && (('A' <= int_charr && int_charr <= 'Z')|| ('a' <= int_charr && int_charr <= 'z')))
+            while (charr != EOF && i < length_max - 5 && is_word_codepoint(charr))
             {
-                if ('A' <= int_charr && int_charr <= 'Z')
-                {
-                    if (i == 0)
-                    {
-                        first_maj = 1;
-                    }
-                    int_charr += 'a' - 'A';
-                }
-                word[i] = int_charr;
-                int_charr = fgetc(file);
-                i++;
+                i += utf8_encode(fold_codepoint(charr), word + i);
+                charr = fget_codepoint(file, bytes, &nb_bytes);
             }
             word[i] = '\0';
             
             ////////////////////////////
-            if (exist_eng(word) == 2)
+            if (exist_eng(word) == 2 && !junk_count(default_lexicon(), word, junk))
             {
                 char* t_word = first_solution(word);
-                if (strlen(t_word) >= 1 && first_maj == 1)
+                if (first_maj == 1)
                 {
-                    t_word[0] -= ('a' - 'A');
+                    utf8_upper_first(t_word);
                 }
                 fputs(t_word, file_dupli);
                 printf("mot[%i] = %s\n",index, t_word);
-                free(t_word);
             }
             else
             {
-                if (strlen(word) >= 1 && first_maj == 1)
+                if (first_maj == 1)
                 {
-                    word[0] -= ('a' - 'A');
+                    utf8_upper_first(word);
                 }
                 fputs(word, file_dupli);
                 printf("mot[%i] = %s\n",index, word);
             }
             index++;
-            free(word);
-            while (int_charr != EOF && !('A' <= int_charr && int_charr <= 'Z')&& !('a' <= int_charr && int_charr <= 'z'))
-            {
-                // insertion fichier int_charr
-                char* one_char = malloc(sizeof(char)*1);
-                one_char[0] = int_charr;
-                one_char[1] = '\0';
-                fputs(one_char, file_dupli);
-                //printf("\'%c\' ",int_charr);
-                free(one_char);
-                int_charr = fgetc(file);
-            }
+            arena_release(&thread_arena, mark);
         }
         first_maj = 0;
     }
@@ -715,6 +1183,10 @@ void first_file(char* filename){
     fclose(file_dupli);
 }
 
+void first_file(char* filename){
+    first_file_junk(filename, NULL);
+}
+
 /*
 void first_solution_on_file(char* filename){
     char* fs_filename = malloc(sizeof(char)* )
@@ -743,113 +1215,6 @@ int transform_str_int(char* str)
     return r;
 }
 
-/*
-void modification(char* filenameref, char* filename_dupli, int index_word, int mod)
-{
-    int length_max = 50;
-    int l_filename = strlen(filename);
-    char* start = ".c_";
-    int l_start = strlen(start);
-    int l_filename_dupli = l_start + l_filename;
-    char* filename_dupli = malloc(sizeof(char) * l_filename_dupli);
-    strcpy(filename_dupli, start);
-    strcat(filename_dupli, filename);
-    filename_dupli[l_filename_dupli] = '\0';
-    FILE* file = fopen(filename,"r");
-    FILE* file_dupli = fopen(filename_dupli,"a");
-
-    int first_maj = 0;
-    int index = 0;
-    
-    int int_charr = fgetc(file);
-    if ('A' <= int_charr && int_charr <= 'Z'){
-        int_charr += 'a' - 'A';
-        first_maj = 1;
-    }
-    while (int_charr != EOF)
-    {
-        while (int_charr != EOF && !('A' <= int_charr && int_charr <= 'Z')&& !('a' <= int_charr && int_charr <= 'z'))
-        {
-            // insertion fichier int_charr
-            char* one_char = malloc(sizeof(char)*1);
-            one_char[0] = int_charr;
-            one_char[1] = '\0';
-            fputs(one_char, file_dupli);
-            //printf("\'%c\' ",int_charr);
-            free(one_char);
-            int_charr = fgetc(file);
-        }
-        if (int_charr != EOF)
-        {
-            char* word = malloc(sizeof (char) * length_max);
-            int i = 0;
-            
-            while (int_charr != EOF && (('A' <= int_charr && int_charr <= 'Z')|| ('a' <= int_charr && int_charr <= 'z')))
-            {
-                if ('A' <= int_charr && int_charr <= 'Z')
-                {
-                    if (i == 0)
-                    {
-                        first_maj = 1;
-                    }
-                    int_charr += 'a' - 'A';
-                }
-                word[i] = int_charr;
-                int_charr = fgetc(file);
-                i++;
-            }
-            word[i] = '\0';
-            
-
-            if (i == index_word)
-            {
-                int ind_s = 0:
-                char* test = correction()
-            }
-            ////////////////////////////
-            if (exist_eng(word) == 2)
-            {
-                char* t_word = first_solution(word);
-                if (strlen(t_word) >= 1 && first_maj == 1)
-                {
-                    t_word[0] -= ('a' - 'A');
-                }
-                fputs(t_word, file_dupli);
-                printf("mot[%i] = %s\n",index, t_word);
-                free(t_word);
-            }
-            else
-            {
-                if (strlen(word) >= 1 && first_maj == 1)
-                {
-                    word[0] -= ('a' - 'A');
-                }
-                fputs(word, file_dupli);
-                printf("mot[%i] = %s\n",index, word);
-            }
-            //////////////////////////
-            index++;
-            free(word);
-            while (int_charr != EOF && !('A' <= int_charr && int_charr <= 'Z')&& !('a' <= int_charr && int_charr <= 'z'))
-            {
-                // insertion fichier int_charr
-                char* one_char = malloc(sizeof(char)*1);
-                one_char[0] = int_charr;
-                one_char[1] = '\0';
-                fputs(one_char, file_dupli);
-                //printf("\'%c\' ",int_charr);
-                free(one_char);
-                int_charr = fgetc(file);
-            }
-        }
-        first_maj = 0;
-    }
-    free(filename_dupli);
-    fclose(file);
-    fclose(file_dupli);
-}
-*/
-
 void put_in_file(char* str, char* filename){
     FILE* file = fopen(filename,"w");
     fputs(str, file);
@@ -880,76 +1245,4465 @@ char* from_file(char* filename){ // don t forget to free() the string after usag
 }
 
 
-///////////////////////////// MAIN OPENFILE /////////////////////////////////
+/////////////////////////// PARTIE LEXIQUE ///////////////////////////////////
 /*
-int main(int argc, char* argv[]){
+    Lexiques en memoire : chaque dictionnaire (dictionary_eng/length_N.txt,
+    dictionary_fra/length_N.txt, ...) est charge une fois, par longueur, avec
+    son index de recherche exacte (table de hachage par longueur) et son profil
+    de trigrammes de caracteres. Le registre garde plusieurs lexiques cote a
+    cote ; chaque ligne est routee vers la langue detectee, et si la detection
+    hesite on interroge tous les lexiques et on garde la meilleure correction.
+*/
 
-    //correction_solutions(argv[1], 0, 1);
-    int first = 1;
-    int done = 0;
-    if (argc == 3 && strcmp("file" , argv[1]) == 0){
-        first = 0;
-        done = 1;
-        first_file(argv[2]);
-    }
-    
-    
-    int display_argv = 0; // FALSE
-    
-    if (argc == 2){
-        //char* r = correction(argv[1], 0, 0);
-        //printf("correction : %s\n", r);
-        //free(r);
-        int argv2 = 0;
-        int argv3 = 0;
-        if (display_argv == 1){
-            printf("argv2 = %i\n",argv2);
-            printf("argv3 = %i\n", argv3);
-        }
-        correction_solutions(argv[1], argv2, argv3);
-        done = 1;
-    } 
-    if (first == 1 && argc == 3){
-        int argv2 = transform_str_int(argv[2]);
-        int argv3 = 0;
-        if (display_argv == 1){
-            printf("argv2 = %i\n",argv2);
-            printf("argv3 = %i\n", argv3);
-        }
-        //char* r = correction(argv[1], argv2, 0);
-        //printf("correction : %s\n", r);
-        //free(r);
-        correction_solutions(argv[1],argv2,argv3);
-        done = 1;
+#define LEXICON_MAX_LENGTH 64
+#define LEXICON_MAX 8
+#define TRIGRAM_SYMBOLS 28      // a-z, autre lettre et le bord de mot
+#define TRIGRAM_SIZE (TRIGRAM_SYMBOLS * TRIGRAM_SYMBOLS * TRIGRAM_SYMBOLS)
+#define TRIGRAM_FLOOR 1e-5     // probabilite d'un trigramme jamais vu
+#define DETECT_MARGIN 0.1f      // ecart moyen par trigramme sous lequel on interroge tous les lexiques
+
+struct bucket {
+    char *words;            // count mots de stride octets, '\0' final, ordre du fichier
+    int count;
+    int stride;
+    unsigned int *hash;     // adressage ouvert : indice du mot + 1, 0 = vide
+    unsigned int hash_mask;
+    uint64_t *packed;       // mots ASCII <= PACKED_MAX_LENGTH : 1 ou 2 entiers par mot
+    int packed_words;       // entiers par mot (0 : paquet non compacte)
+    uint32_t *masks;        // symboles de chaque mot (symbol_mask), par MASK_BLOCK
+    int capacity;           // mots alloues dans words / packed, hash prevu pour capacity
+    int dead;               // mots retires (chaine vide) pas encore compactes
+    struct shared_arena *store; // memoire du paquet, partagee entre versions du lexique
+};
+
+struct lexicon {
+    struct shared_arena *profile;   // trigram_counts, trigram et bigram
+    char name[16];
+    char prefix[256];       // "dictionary_eng/length_"
+    struct bucket buckets[LEXICON_MAX_LENGTH + 1];
+    float *trigram;         // log-probabilite de chaque trigramme
+    float *bigram;          // log-probabilite de chaque bigramme (filtre des dechets)
+    unsigned int *trigram_counts;   // occurrences de chaque trigramme, suivies par lexicon_edit
+    unsigned long nb_trigrams;
+    int nb_words;
+};
+
+/*
+    Mots compactes : un mot ASCII de 8 lettres au plus tient dans un entier
+    de 64 bits (deux pour 16 lettres). A longueur egale (plus == 0, le cas
+    le plus courant en OCR), la distance de Hamming s'obtient par XOR et un
+    comptage des octets non nuls, sans boucle sur les lettres. C'est une
+    borne superieure de la distance de Levenshtein, et elles sont egales
+    jusqu'a 2 : on ne calcule la vraie distance que si Hamming >= 3 et que
+    le mot peut encore battre le meilleur trouve.
+*/
+#define PACKED_MAX_LENGTH 16
+#define PACKED_BLOCK 256
+#define BYTES_LOW_BITS 0x0101010101010101ULL
+
+struct packed_query {
+    int ok;
+    uint64_t word[2];
+};
+
+struct lexicon *lexicons[LEXICON_MAX];
+int nb_lexicons = 0;
+
+static unsigned int hash_word(const char *word, int length)
+{
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < length; i++){
+        h ^= (unsigned char)word[i];
+        h *= 16777619u;
     }
-    if (argc == 4){
-        int argv2 = transform_str_int(argv[2]);
-        int argv3 = transform_str_int(argv[3]);
-        if (display_argv == 1){
-            printf("argv2 = %i\n",argv2);
-            printf("argv3 = %i\n", argv3);
-        }
-        //char* r = correction(argv[1], argv2, argv3);
-        //printf("correction : %s\n", r);
-        //free(r);
-        correction_solutions(argv[1],argv2, argv3);
-        done = 1;
+    return h;
+}
+
+static int trigram_symbol(unsigned int cp)
+{
+    cp = fold_codepoint(cp);
+    if ('a' <= cp && cp <= 'z')
+        return cp - 'a' + 1;
+    if (is_word_codepoint(cp))
+        return TRIGRAM_SYMBOLS - 1;
+    return 0;
+}
+
+static void bucket_hash_insert(struct bucket *b, int i)
+{
+    char *word = b->words + i * b->stride;
+    unsigned int h = hash_word(word, strlen(word)) & b->hash_mask;
+    while (b->hash[h] != 0)
+        h = (h + 1) & b->hash_mask;
+    b->hash[h] = i + 1;
+}
+
+static void lexicon_index_bucket(struct bucket *b)
+{
+    unsigned int size = 16;
+    while (size < 2 * (unsigned int)b->capacity)
+        size *= 2;
+    b->hash = arena_alloc(&b->store->arena, size * sizeof(unsigned int));
+    memset(b->hash, 0, size * sizeof(unsigned int));
+    b->hash_mask = size - 1;
+    for (int i = 0; i < b->count; i++)
+        if (b->words[i * b->stride] != '\0')     // place vide du lexique vivant
+            bucket_hash_insert(b, i);
+}
+
+static void pack_word(const char *word, int length, uint64_t out[2])
+{
+    out[0] = 0;
+    out[1] = 0;
+    for (int k = 0; k < length; k++)
+        out[k / 8] |= (uint64_t)(unsigned char)word[k] << (8 * (k % 8));
+}
+
+#define MASK_BLOCK 16               // masques bornes par tour de boucle (vectorisee)
+#define MASK_SYMBOLS 0x7FFFFFFu
+#define MASK_ROUND(n) (((n) + MASK_BLOCK - 1) & ~(MASK_BLOCK - 1))
+
+// Bit s pour chaque symbole s (a..z, autre lettre) du mot, et le nombre de
+// ces bits au dessus de MASK_SYMBOLS ; sert a la borne de la recherche
+// avec budget
+static uint32_t symbol_mask(const char *word)
+{
+    size_t len = strlen(word), k = 0;
+    uint32_t mask = 0;
+    while (k < len)
+        mask |= 1u << trigram_symbol(utf8_decode(word, len, &k));
+    mask &= MASK_SYMBOLS & ~1u;
+    return mask | (uint32_t)__builtin_popcount(mask) << 27;
+}
+
+// Les masques sont alloues par MASK_BLOCK, la fin a zero
+static uint32_t *bucket_masks_alloc(struct bucket *b, int capacity)
+{
+    size_t size = MASK_ROUND((size_t)capacity) * sizeof(uint32_t);
+    uint32_t *masks = arena_alloc(&b->store->arena, size);
+    memset(masks, 0, size);
+    return masks;
+}
+
+static void lexicon_mask_bucket(struct bucket *b)
+{
+    b->masks = bucket_masks_alloc(b, b->capacity);
+    for (int i = 0; i < b->count; i++)
+        b->masks[i] = symbol_mask(b->words + i * b->stride);
+}
+
+static void lexicon_pack_bucket(struct bucket *b, int length)
+{
+    b->packed_words = 0;
+    if (length > PACKED_MAX_LENGTH || b->stride != length + 1 || b->count == 0)
+        return;
+    int nb = length > 8 ? 2 : 1;
+    b->packed = arena_alloc(&b->store->arena, (size_t)b->capacity * nb * sizeof(uint64_t));
+    for (int i = 0; i < b->count; i++){
+        uint64_t w[2];
+        pack_word(b->words + i * b->stride, length, w);
+        memcpy(b->packed + (size_t)i * nb, w, nb * sizeof(uint64_t));
     }
-    if (done == 0){
-        printf("Usage : ./a.out [word] [length_min] [length_max]\n");
+    b->packed_words = nb;
+}
+
+// Nombre d'octets non nuls de x : chaque octet est replie sur son bit de poids faible
+static inline int nonzero_bytes(uint64_t x)
+{
+    x |= x >> 4;
+    x |= x >> 2;
+    x |= x >> 1;
+    return __builtin_popcountll(x & BYTES_LOW_BITS);
+}
+
+// Le raccourci ne vaut que pour plus == 0 et un mot OCR ASCII
+static void pack_query(struct bucket *b, const char *word, int plus, struct packed_query *pq)
+{
+    int length = strlen(word);
+    pq->ok = 0;
+    if (plus != 0 || b->packed_words == 0 || length + 1 != b->stride)
+        return;
+    for (int k = 0; k < length; k++){
+        if ((unsigned char)word[k] >= 0x80)
+            return;
     }
+    pack_word(word, length, pq->word);
+    pq->ok = 1;
+}
 
-    return 0;
-}*/
+// Distances de Hamming des mots [start, end) du paquet ; boucle sans
+// branchement, vectorisable par le compilateur
+static void packed_hamming_block(struct bucket *b, int start, int end, const struct packed_query *pq, unsigned char *hamming)
+{
+    if (b->packed_words == 1){
+        const uint64_t *p = b->packed + start;
+        for (int i = 0; i < end - start; i++)
+            hamming[i] = nonzero_bytes(p[i] ^ pq->word[0]);
+    }
+    else{
+        const uint64_t *p = b->packed + 2 * (size_t)start;
+        for (int i = 0; i < end - start; i++)
+            hamming[i] = nonzero_bytes(p[2 * i] ^ pq->word[0]) + nonzero_bytes(p[2 * i + 1] ^ pq->word[1]);
+    }
+}
+
+// Distance du mot candidat au mot OCR, ou 50 si la borne de Hamming h montre
+// qu'il ne peut rien changer (distance > min_dist, ou egale sans egalite a prendre)
+static inline unsigned int packed_distance(const char *word, const char *ocr_word, unsigned int h, unsigned int min_dist, int ties)
+{
+    unsigned int lower = h < 2 ? h : 2;
+    if (lower > min_dist || (lower == min_dist && !ties))
+        return 50;
+    if (h <= 2)
+        return h;
+    return levenshtein_distance(word, ocr_word);
+}
+
+// Distance d'un candidat, par le raccourci de Hamming si la requete est compactee
+static inline unsigned int candidate_distance(const char *word, const char *ocr_word, const struct packed_query *pq,
+                                              unsigned int h, unsigned int min_dist, int ties)
+{
+    if (pq->ok)
+        return packed_distance(word, ocr_word, h, min_dist, ties);
+    return levenshtein_distance(word, ocr_word);
+}
+
+/*
+    Regle d'egalite de correction(), commune a tous les parcours d'un
+    paquet : parmi les mots a distance minimale, on garde le nb-ieme dans
+    l'ordre du fichier (le dernier s'il y en a moins).
+    - tie_scan : les mots arrivent dans l'ordre du fichier ;
+    - tie_set : ils arrivent dans un autre ordre (lexique compresse,
+      recherche avec budget) ; on garde les nb + 1 plus petits rangs a
+      distance minimale, tries, et le resultat est le dernier.
+*/
+struct tie_scan {
+    unsigned int min_dist;
+    int nb;
+    int nbb;                // egalites qui peuvent encore changer le resultat
+    int best;               // indice retenu, -1 si aucun
+    int count;              // mots a distance minimale
+};
+
+static inline void tie_scan_init(struct tie_scan *t, int nb)
+{
+    t->min_dist = 50;
+    t->nb = nb;
+    t->nbb = nb;
+    t->best = -1;
+    t->count = 0;
+}
+
+static inline void tie_scan_add(struct tie_scan *t, unsigned int distance, int i)
+{
+    if (distance == t->min_dist){
+        t->count++;
+        if (t->nbb > 0){
+            t->nbb--;
+            t->best = i;
+        }
+    }
+    if (distance < t->min_dist){
+        t->min_dist = distance;
+        t->nbb = t->nb;
+        t->best = i;
+        t->count = 1;
+    }
+}
+
+struct tie_set {
+    unsigned int min_dist;
+    int capacity;           // nb + 1
+    int count;
+    unsigned int *rank;     // rangs dans le fichier, croissants
+    int *item;              // ce que l'appelant associe au rang (peut etre NULL)
+};
+
+static inline void tie_set_init(struct tie_set *t, int capacity, unsigned int *rank, int *item)
+{
+    t->min_dist = 50;
+    t->capacity = capacity;
+    t->count = 0;
+    t->rank = rank;
+    t->item = item;
+}
+
+// 1 si un mot de ce rang a la distance minimale entrerait dans l'ensemble
+static inline int tie_set_open(const struct tie_set *t, unsigned int rank)
+{
+    return t->count < t->capacity || rank < t->rank[t->capacity - 1];
+}
+
+static inline void tie_set_add(struct tie_set *t, unsigned int distance, unsigned int rank, int item)
+{
+    if (distance > t->min_dist)
+        return;
+    if (distance < t->min_dist){
+        t->min_dist = distance;
+        t->count = 0;
+    }
+    else if (!tie_set_open(t, rank))
+        return;
+    // insertion triee, le plus grand rang sort si l'ensemble est plein
+    int j = t->count < t->capacity ? t->count++ : t->capacity - 1;
+    while (j > 0 && t->rank[j - 1] > rank){
+        t->rank[j] = t->rank[j - 1];
+        if (t->item != NULL)
+            t->item[j] = t->item[j - 1];
+        j--;
+    }
+    t->rank[j] = rank;
+    if (t->item != NULL)
+        t->item[j] = item;
+}
+
+// Ajoute delta (1 ou -1) aux trigrammes du mot ; renvoie leur nombre
+static unsigned long profile_count_word(unsigned int *counts, const char *word, int delta)
+{
+    size_t len = strlen(word), k = 0;
+    unsigned long n = 0;
+    int s0 = 0, s1 = 0, end = 0;
+    while (!end){
+        int s2 = 0;
+        if (k < len)
+            s2 = trigram_symbol(utf8_decode(word, len, &k));
+        else
+            end = 1;
+        counts[(s0 * TRIGRAM_SYMBOLS + s1) * TRIGRAM_SYMBOLS + s2] += delta;
+        n++;
+        s0 = s1;
+        s1 = s2;
+    }
+    return n;
+}
+
+// Tables trigram et bigram a partir des comptes
+static void profile_tables(struct lexicon *lex)
+{
+    unsigned int *counts = lex->trigram_counts;
+    double total = lex->nb_trigrams;
+    for (int t = 0; t < TRIGRAM_SIZE; t++){
+        // plancher fixe pour les trigrammes absents, sinon un petit lexique
+        // serait favorise par le lissage
+        double p = counts[t] / (total + 1);
+        lex->trigram[t] = p > TRIGRAM_FLOOR ? (float)log(p) : (float)log(TRIGRAM_FLOOR);
+    }
+    // bigramme (s1, s2) : somme sur s0 des trigrammes (s0, s1, s2)
+    for (int d = 0; d < TRIGRAM_SYMBOLS * TRIGRAM_SYMBOLS; d++){
+        double count = 0;
+        for (int s0 = 0; s0 < TRIGRAM_SYMBOLS; s0++)
+            count += counts[s0 * TRIGRAM_SYMBOLS * TRIGRAM_SYMBOLS + d];
+        double p = count / (total + 1);
+        lex->bigram[d] = p > TRIGRAM_FLOOR ? (float)log(p) : (float)log(TRIGRAM_FLOOR);
+    }
+}
+
+// Profil dans une arene a lui ; counts (si non NULL) est recopie, sinon
+// les comptes partent de zero
+static void profile_alloc(struct lexicon *lex, const unsigned int *counts)
+{
+    lex->profile = shared_arena_new();
+    lex->trigram_counts = arena_alloc(&lex->profile->arena, TRIGRAM_SIZE * sizeof(unsigned int));
+    if (counts != NULL)
+        memcpy(lex->trigram_counts, counts, TRIGRAM_SIZE * sizeof(unsigned int));
+    else
+        memset(lex->trigram_counts, 0, TRIGRAM_SIZE * sizeof(unsigned int));
+    lex->trigram = arena_alloc(&lex->profile->arena, TRIGRAM_SIZE * sizeof(float));
+    lex->bigram = arena_alloc(&lex->profile->arena, TRIGRAM_SYMBOLS * TRIGRAM_SYMBOLS * sizeof(float));
+}
+
+static void lexicon_profile(struct lexicon *lex)
+{
+    profile_alloc(lex, NULL);
+    lex->nb_trigrams = 0;
+    for (int l = 1; l <= LEXICON_MAX_LENGTH; l++){
+        struct bucket *b = &lex->buckets[l];
+        for (int i = 0; i < b->count; i++)
+            lex->nb_trigrams += profile_count_word(lex->trigram_counts, b->words + i * b->stride, 1);
+    }
+    profile_tables(lex);
+}
+
+void lexicon_free(struct lexicon *lex)
+{
+    for (int l = 1; l <= LEXICON_MAX_LENGTH; l++)
+        shared_arena_put(lex->buckets[l].store);
+    shared_arena_put(lex->profile);
+    free(lex);
+}
+
+// Charge prefix + N + ".txt" pour chaque longueur N (NULL si aucun fichier)
+struct lexicon *lexicon_load(const char *name, const char *prefix)
+{
+    struct lexicon *lex = calloc(1, sizeof(struct lexicon));
+    strncpy(lex->name, name, sizeof(lex->name) - 1);
+    strncpy(lex->prefix, prefix, sizeof(lex->prefix) - 1);
+    for (int l = 1; l <= LEXICON_MAX_LENGTH; l++){
+        struct arena_mark mark = arena_mark(&thread_arena);
+        FILE* file = fopen(convert_prefix_length_filename(prefix, l), "r");
+        arena_release(&thread_arena, mark);
+        if (file == NULL)
+            continue;
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        char *content = arena_alloc(&thread_arena, size + 1);
+        size = fread(content, 1, size, file);
+        content[size] = '\0';
+        fclose(file);
+
+        // une ligne garde si elle fait l caracteres ; stride = plus longue
+        // ligne en octets, pour les mots accentues
+        struct bucket *b = &lex->buckets[l];
+        int nb_lines = 1;
+        int max_bytes = l;
+        long k = 0;
+        while (k < size){
+            long start = k;
+            int chars = 0;
+            while (k < size && content[k] != '\n' && content[k] != '\r')
+                chars += ((unsigned char)content[k++] & 0xC0) != 0x80;
+            if (chars == l && k - start > max_bytes)
+                max_bytes = k - start;
+            while (k < size && (content[k] == '\n' || content[k] == '\r'))
+                nb_lines += content[k++] == '\n';
+        }
+        b->stride = max_bytes + 1;
+        b->capacity = nb_lines;
+        b->store = shared_arena_new();
+        b->words = arena_alloc(&b->store->arena, (size_t)nb_lines * b->stride);
+        k = 0;
+        while (k < size){
+            long start = k;
+            int chars = 0;
+            while (k < size && content[k] != '\n' && content[k] != '\r')
+                chars += ((unsigned char)content[k++] & 0xC0) != 0x80;
+            if (chars == l){
+                char *word = b->words + b->count * b->stride;
+                memset(word, 0, b->stride);
+                memcpy(word, content + start, k - start);
+                b->count++;
+            }
+            while (k < size && (content[k] == '\n' || content[k] == '\r'))
+                k++;
+        }
+        arena_release(&thread_arena, mark);
+        lexicon_index_bucket(b);
+        lexicon_pack_bucket(b, l);
+        lexicon_mask_bucket(b);
+        lex->nb_words += b->count;
+    }
+    if (lex->nb_words == 0){
+        lexicon_free(lex);
+        return NULL;
+    }
+    lexicon_profile(lex);
+    return lex;
+}
+
+
+// Meme convention que exist_eng : 0 trop court, 1 dans le lexique, 2 sinon
+int lexicon_exist(struct lexicon *lex, const char *word)
+{
+    int l_word = utf8_length(word);
+    int bytes = strlen(word);
+    if (l_word < 3)
+        return 0;
+    if (l_word > LEXICON_MAX_LENGTH)
+        return 2;
+    struct bucket *b = &lex->buckets[l_word];
+    if (b->count == 0 || bytes >= b->stride)
+        return 2;
+    unsigned int h = hash_word(word, bytes) & b->hash_mask;
+    while (b->hash[h] != 0){
+        if (memcmp(b->words + (b->hash[h] - 1) * b->stride, word, bytes + 1) == 0)
+            return 1;
+        h = (h + 1) & b->hash_mask;
+    }
+    return 2;
+}
+
+// Indice du mot [word, word + bytes) de length caracteres, -1 s'il n'est pas
+// dans le lexique ; sans copie, pour chercher un morceau de texte
+int lexicon_find(struct lexicon *lex, const char *word, int bytes, int length)
+{
+    if (length < 1 || length > LEXICON_MAX_LENGTH)
+        return -1;
+    struct bucket *b = &lex->buckets[length];
+    if (b->count == 0 || bytes >= b->stride)
+        return -1;
+    unsigned int h = hash_word(word, bytes) & b->hash_mask;
+    while (b->hash[h] != 0){
+        const char *entry = b->words + (b->hash[h] - 1) * b->stride;
+        if (entry[bytes] == '\0' && memcmp(entry, word, bytes) == 0)
+            return b->hash[h] - 1;
+        h = (h + 1) & b->hash_mask;
+    }
+    return -1;
+}
+
+// Mots [start, end) du paquet b compares a ocr_word, dans l'ordre du fichier
+static void bucket_scan(struct bucket *b, const char *ocr_word, const struct packed_query *pq, int start, int end, struct tie_scan *t)
+{
+    unsigned char hamming[PACKED_BLOCK];
+    for (int block = start; block < end; block += PACKED_BLOCK){
+        int block_end = block + PACKED_BLOCK < end ? block + PACKED_BLOCK : end;
+        if (pq->ok)
+            packed_hamming_block(b, block, block_end, pq, hamming);
+        for (int i = block; i < block_end; i++){
+            const char *word = b->words + i * b->stride;
+            // mot retire (lexique vivant) : on ne lit word que s'il y en a
+            if (b->dead > 0 && word[0] == '\0')
+                continue;
+            unsigned int h = pq->ok ? hamming[i - block] : 0;
+            tie_scan_add(t, candidate_distance(word, ocr_word, pq, h, t->min_dist, t->nbb > 0), i);
+        }
+    }
+}
+
+// Parcours du paquet de longueur utf8_length(word) + plus, avec la meme
+// regle d'egalite que correction() : indice du mot retenu ou -1
+static int lexicon_search(struct lexicon *lex, const char *ocr_word, int nb, int plus, unsigned int *dist)
+{
+    int l_word = utf8_length(ocr_word) + plus;
+    *dist = 50;
+    if (l_word < 1 || l_word > LEXICON_MAX_LENGTH)
+        return -1;
+    struct bucket *b = &lex->buckets[l_word];
+    struct packed_query pq;
+    struct tie_scan t;
+    tie_scan_init(&t, nb);
+    pack_query(b, ocr_word, plus, &pq);
+    bucket_scan(b, ocr_word, &pq, 0, b->count, &t);
+    *dist = t.min_dist;
+    return t.best;
+}
+
+char* lexicon_correction(struct lexicon *lex, char* ocr_word, int nb, int plus) // thread_arena
+{
+    unsigned int distance;
+    if (utf8_length(ocr_word) < 3)
+        return arena_strdup(&thread_arena, ocr_word);
+    int best = lexicon_search(lex, ocr_word, nb, plus, &distance);
+    if (best < 0)
+        return arena_strdup(&thread_arena, ocr_word);
+    struct bucket *b = &lex->buckets[utf8_length(ocr_word) + plus];
+    return arena_strdup(&thread_arena, b->words + best * b->stride);
+}
+
+int lexicon_nb_solutions(struct lexicon *lex, char* word, int plus)
+{
+    int l_word = utf8_length(word);
+    if (l_word < 3 || l_word + plus < 1 || l_word + plus > LEXICON_MAX_LENGTH)
+        return 0;
+    struct bucket *b = &lex->buckets[l_word + plus];
+    struct packed_query pq;
+    struct tie_scan t;
+    // nb = count : toutes les egalites sont comptees exactement
+    tie_scan_init(&t, b->count);
+    pack_query(b, word, plus, &pq);
+    bucket_scan(b, word, &pq, 0, b->count, &t);
+    return t.count;
+}
+
+/*
+    Filtre des dechets d'OCR ("lll", suites de consonnes, morceaux de
+    tableaux) : un mot inconnu qui n'a pas l'air d'un mot est laisse tel
+    quel au lieu de parcourir tout un paquet pour le "corriger" en
+    n'importe quoi. Une seule passe sur le mot, trois regles :
+    - une meme lettre repetee max_run fois de suite ou plus ;
+    - a partir de min_length lettres, moins de min_vowels voyelles par lettre ;
+    - plus de max_bad_bigrams bigrammes (debut et fin de mot compris) dont
+      la log-probabilite dans le lexique est sous min_bigram.
+    Une erreur d'OCR sur une lettre change au plus deux bigrammes, d'ou
+    max_bad_bigrams = 2 par defaut. Avec ces seuils, sur des mots du
+    lexique anglais dont une lettre est changee, moins de 0.5% sont rejetes
+    (surtout des lettres triplees), et le test coute quelques dizaines de ns.
+*/
+enum junk_reason {JUNK_NONE, JUNK_RUN, JUNK_VOWELS, JUNK_BIGRAMS, JUNK_REASONS};
+
+struct junk_thresholds {
+    int max_run;
+    int min_length;
+    float min_vowels;
+    float min_bigram;
+    int max_bad_bigrams;
+};
+
+struct junk_thresholds junk_thresholds = {3, 6, 0.10f, -11.0f, 2};
+
+struct junk_stats {
+    unsigned long checked;              // mots inconnus passes au filtre
+    unsigned long rejected[JUNK_REASONS];
+};
+
+static const char *junk_reason_name[JUNK_REASONS] = {"", "repetition", "voyelles", "bigrammes"};
+
+// Les lettres hors a..z (accents, grec, cyrillique) comptent comme voyelles :
+// le filtre ne doit pas rejeter un mot etranger faute de savoir le lire
+static inline int junk_vowel(int symbol)
+{
+    static const unsigned int vowels = 1u << 1 | 1u << 5 | 1u << 9 | 1u << 15 | 1u << 21 | 1u << 25 | 1u << (TRIGRAM_SYMBOLS - 1);
+    return (vowels >> symbol) & 1;
+}
+
+// Raison du rejet d'un mot en minuscules, JUNK_NONE s'il faut le corriger
+int junk_token(struct lexicon *lex, const char *word)
+{
+    size_t len = strlen(word), k = 0;
+    unsigned int previous = 0;
+    int run = 0, letters = 0, vowels = 0, bad = 0;
+    int s1 = 0, end = 0;
+    while (!end){
+        int s2 = 0;
+        if (k < len){
+            unsigned int cp = utf8_decode(word, len, &k);
+            s2 = trigram_symbol(cp);
+            run = cp == previous ? run + 1 : 1;
+            if (run >= junk_thresholds.max_run)
+                return JUNK_RUN;
+            previous = cp;
+            letters++;
+            vowels += junk_vowel(s2);
+        }
+        else
+            end = 1;
+        bad += lex->bigram[s1 * TRIGRAM_SYMBOLS + s2] < junk_thresholds.min_bigram;
+        s1 = s2;
+    }
+    if (letters >= junk_thresholds.min_length && vowels < junk_thresholds.min_vowels * letters)
+        return JUNK_VOWELS;
+    if (bad > junk_thresholds.max_bad_bigrams)
+        return JUNK_BIGRAMS;
+    return JUNK_NONE;
+}
+
+// Filtre avec comptage, stats peut etre NULL
+static int junk_count(struct lexicon *lex, const char *word, struct junk_stats *stats)
+{
+    int reason = junk_token(lex, word);
+    if (stats != NULL){
+        stats->checked++;
+        stats->rejected[reason]++;
+    }
+    return reason;
+}
+
+void print_junk_stats(struct junk_stats *stats)
+{
+    unsigned long total = 0;
+    for (int r = JUNK_NONE + 1; r < JUNK_REASONS; r++)
+        total += stats->rejected[r];
+    printf("dechets : %lu rejetes sur %lu mots inconnus (%.1f%%)\n", total, stats->checked,
+           stats->checked ? 100.0 * total / stats->checked : 0);
+    printf("%12s seuils : repetition >= %d, voyelles < %.2f par lettre des %d lettres, plus de %d bigrammes < %.1f\n", "",
+           junk_thresholds.max_run, junk_thresholds.min_vowels, junk_thresholds.min_length,
+           junk_thresholds.max_bad_bigrams, junk_thresholds.min_bigram);
+    for (int r = JUNK_NONE + 1; r < JUNK_REASONS; r++)
+        printf("%12s %-10s %lu\n", "", junk_reason_name[r], stats->rejected[r]);
+}
+
+int registry_add(const char *name, const char *prefix)
+{
+    if (nb_lexicons >= LEXICON_MAX)
+        return -1;
+    struct lexicon *lex = lexicon_load(name, prefix);
+    if (lex == NULL)
+        return -1;
+    lexicons[nb_lexicons] = lex;
+    return nb_lexicons++;
+}
+
+// Premier lexique du registre, "eng" charge a la demande s'il est vide
+struct lexicon *default_lexicon(void)
+{
+    if (nb_lexicons == 0 && registry_add("eng", "dictionary_eng/length_") < 0)
+        return NULL;
+    return lexicons[0];
+}
+
+void registry_free(void)
+{
+    for (int i = 0; i < nb_lexicons; i++)
+        lexicon_free(lexicons[i]);
+    nb_lexicons = 0;
+}
+
+// Langue la plus probable pour le texte [text, text + len) d'apres les
+// trigrammes de ses mots. *sure = 0 si l'ecart avec la deuxieme est faible.
+int lexicon_detect(const char *text, size_t len, int *sure)
+{
+    float score[LEXICON_MAX] = {0};
+    int nb_trigrams = 0;
+    int s0 = 0, s1 = 0;
+    *sure = 1;
+    if (nb_lexicons <= 1)
+        return 0;
+    size_t k = 0;
+    while (k <= len){
+        int s2 = 0;
+        if (k < len)
+            s2 = trigram_symbol(utf8_decode(text, len, &k));
+        else
+            k++;
+        if (s1 == 0 && s2 == 0){
+            s0 = 0;
+            continue;
+        }
+        int t = (s0 * TRIGRAM_SYMBOLS + s1) * TRIGRAM_SYMBOLS + s2;
+        for (int i = 0; i < nb_lexicons; i++)
+            score[i] += lexicons[i]->trigram[t];
+        nb_trigrams++;
+        s0 = s1;
+        s1 = s2;
+    }
+    int best = 0, second = -1;
+    for (int i = 1; i < nb_lexicons; i++){
+        if (score[i] > score[best]){
+            second = best;
+            best = i;
+        }
+        else if (second < 0 || score[i] > score[second]){
+            second = i;
+        }
+    }
+    if (nb_trigrams == 0 || (score[best] - score[second]) / nb_trigrams < DETECT_MARGIN)
+        *sure = 0;
+    return best;
+}
+
+// Correction d'un mot en minuscules : inchange s'il est dans un des lexiques,
+// sinon corrige dans la langue lang, ou dans tous les lexiques si sure == 0
+// (la plus petite distance gagne, la langue detectee en cas d'egalite).
+// Les dechets sont laisses tels quels et comptes dans junk (si non NULL).
+char* registry_correction(char *word, int lang, int sure, struct junk_stats *junk) // thread_arena
+{
+    int i;
+    if (nb_lexicons == 0 || utf8_length(word) < 3)
+        return arena_strdup(&thread_arena, word);
+    for (i = 0; i < nb_lexicons; i++){
+        if (lexicon_exist(lexicons[i], word) == 1)
+            return arena_strdup(&thread_arena, word);
+    }
+    if (junk_count(lexicons[lang], word, junk) != JUNK_NONE)
+        return arena_strdup(&thread_arena, word);
+    if (sure)
+        return lexicon_correction(lexicons[lang], word, 0, 0);
+    unsigned int best_dist;
+    int best_lang = lang;
+    int best = lexicon_search(lexicons[lang], word, 0, 0, &best_dist);
+    for (i = 0; i < nb_lexicons; i++){
+        unsigned int distance;
+        int r = i == lang ? -1 : lexicon_search(lexicons[i], word, 0, 0, &distance);
+        if (r >= 0 && (best < 0 || distance < best_dist)){
+            best = r;
+            best_dist = distance;
+            best_lang = i;
+        }
+    }
+    if (best < 0)
+        return arena_strdup(&thread_arena, word);
+    struct bucket *b = &lexicons[best_lang]->buckets[utf8_length(word)];
+    return arena_strdup(&thread_arena, b->words + best * b->stride);
+}
+
+// Comme first_file, mais avec les lexiques du registre : la langue est
+// detectee ligne par ligne, en une seule passe sur le fichier.
+void first_file_multi(char* filename, struct junk_stats *junk)
+{
+    char* start = "c_";
+    char* filename_dupli = malloc(strlen(start) + strlen(filename) + 1);
+    strcpy(filename_dupli, start);
+    strcat(filename_dupli, filename);
+    FILE* file = fopen(filename,"r");
+    FILE* file_dupli = fopen(filename_dupli,"w");
+    free(filename_dupli);
+    if (file == NULL || file_dupli == NULL){
+        if (file != NULL)
+            fclose(file);
+        if (file_dupli != NULL)
+            fclose(file_dupli);
+        return;
+    }
+
+    size_t cap = 256;
+    char *line = malloc(cap);
+    int int_charr = fgetc(file);
+    while (int_charr != EOF){
+        size_t len = 0;
+        while (int_charr != EOF){
+            if (len + 1 >= cap){
+                char *bigger = malloc(cap * 2);
+                memcpy(bigger, line, len);
+                free(line);
+                line = bigger;
+                cap *= 2;
+            }
+            line[len++] = int_charr;
+            int_charr = fgetc(file);
+            if (line[len - 1] == '\n')
+                break;
+        }
+        int sure;
+        int lang = lexicon_detect(line, len, &sure);
+        size_t i = 0;
+        while (i < len){
+            size_t n = utf8_word_char(line, len, i);
+            if (n == 0){
+                fputc(line[i++], file_dupli);
+                continue;
+            }
+            struct arena_mark mark = arena_mark(&thread_arena);
+            size_t w = i;
+            while (n > 0){
+                i += n;
+                n = i < len ? utf8_word_char(line, len, i) : 0;
+            }
+            char *word = arena_alloc(&thread_arena, i - w + 1);
+            utf8_fold(word, line + w, i - w);
+            char *t_word = registry_correction(word, lang, sure, junk);
+            if (utf8_first_upper(line + w, i - w))
+                utf8_upper_first(t_word);
+            fputs(t_word, file_dupli);
+            arena_release(&thread_arena, mark);
+        }
+    }
+    free(line);
+    fclose(file);
+    fclose(file_dupli);
+}
+
+/////////////////////////// PARTIE LEXIQUE VIVANT ///////////////////////////
+/*
+    Lexique modifiable pendant que les corrections tournent (mots ajoutes
+    ou retires, rechargement depuis les fichiers), facon RCU :
+    - les lecteurs prennent la version courante sans verrou : ils se
+      declarent dans un emplacement (epoque lue) par un seul CAS, puis
+      lisent le pointeur ; la version ne bouge pas tant qu'ils la tiennent ;
+    - un seul ecrivain a la fois (mutex) prepare une copie privee, la publie
+      par un echange atomique, incremente l'epoque et attend que plus aucun
+      emplacement ne soit d'une epoque anterieure avant de liberer
+      l'ancienne version ;
+    - la copie partage les paquets non touches (arene partagee comptee) ;
+      un paquet modifie est recopie une fois par mise a jour, avec de la
+      place d'avance, et son index (hash, mots compactes) est mis a jour
+      mot par mot au lieu d'etre reconstruit. Un mot retire laisse une
+      place vide (chaine vide, sautee par les parcours) et sort de la
+      table de hachage ; le paquet est compacte quand un quart des places
+      sont vides. Le profil de trigrammes est recopie de la meme facon,
+      ses comptes suivent les mots et ses tables sont refaites une fois
+      avant la publication.
+    Les mots ajoutes ou retires sont gardes dans un journal et rejoues
+    apres chaque rechargement. Un thread qui tient une version ne doit pas
+    ecrire : l'ecrivain attendrait sa propre lecture.
+*/
+#define LIVE_READERS 64
+
+struct reader_slot {
+    _Atomic unsigned long epoch;    // 0 : libre
+    char pad[64 - sizeof(unsigned long)];
+};
+
+struct live_edit {
+    char *word;
+    int remove;
+};
+
+struct live_lexicon {
+    _Atomic(struct lexicon *) current;
+    _Atomic unsigned long epoch;
+    pthread_mutex_t writer;
+    struct reader_slot slots[LIVE_READERS];
+    struct live_edit *journal;
+    int nb_journal;
+    int journal_cap;
+};
+
+static _Thread_local int live_slot_hint;
+
+// Version courante, a rendre par live_read_unlock(live, *slot)
+struct lexicon *live_read_lock(struct live_lexicon *live, int *slot)
+{
+    unsigned long epoch = atomic_load(&live->epoch);
+    int i = live_slot_hint;
+    for (int tries = 1;; tries++){
+        unsigned long free_slot = 0;
+        if (atomic_compare_exchange_strong(&live->slots[i].epoch, &free_slot, epoch))
+            break;
+        i = (i + 1) % LIVE_READERS;
+        if (tries % LIVE_READERS == 0)
+            sched_yield();
+    }
+    live_slot_hint = i;
+    *slot = i;
+    return atomic_load(&live->current);
+}
+
+void live_read_unlock(struct live_lexicon *live, int slot)
+{
+    atomic_store(&live->slots[slot].epoch, 0);
+}
+
+// Publie next et libere l'ancienne version quand plus aucun lecteur ne la tient
+static void live_publish(struct live_lexicon *live, struct lexicon *next)
+{
+    struct lexicon *old = atomic_exchange(&live->current, next);
+    unsigned long epoch = atomic_fetch_add(&live->epoch, 1) + 1;
+    for (int i = 0; i < LIVE_READERS; i++){
+        for (;;){
+            unsigned long e = atomic_load(&live->slots[i].epoch);
+            if (e == 0 || e >= epoch)
+                break;
+            sched_yield();
+        }
+    }
+    lexicon_free(old);
+}
+
+// Copie privee de lex, les paquets et le profil sont partages
+static struct lexicon *lexicon_clone(struct lexicon *lex)
+{
+    struct lexicon *copy = malloc(sizeof(struct lexicon));
+    memcpy(copy, lex, sizeof(struct lexicon));
+    for (int l = 1; l <= LEXICON_MAX_LENGTH; l++)
+        shared_arena_get(copy->buckets[l].store);
+    shared_arena_get(copy->profile);
+    return copy;
+}
+
+// Recopie le paquet dans une arene a lui, au pas stride avec capacity
+// places. L'index est recopie tel quel si sa taille ne change pas.
+static void bucket_relayout(struct bucket *b, int length, int stride, int capacity)
+{
+    struct bucket old = *b;
+    unsigned int size = 16;
+    while (size < 2 * (unsigned int)capacity)
+        size *= 2;
+    b->store = shared_arena_new();
+    b->stride = stride;
+    b->capacity = capacity;
+    b->words = arena_alloc(&b->store->arena, (size_t)capacity * stride);
+    memset(b->words, 0, (size_t)capacity * stride);
+    if (stride == old.stride){
+        memcpy(b->words, old.words, (size_t)old.count * stride);
+    }
+    else{
+        for (int i = 0; i < old.count; i++)
+            strcpy(b->words + i * stride, old.words + i * old.stride);
+    }
+    if (stride == old.stride && old.hash != NULL && size == old.hash_mask + 1){
+        b->hash = arena_alloc(&b->store->arena, size * sizeof(unsigned int));
+        memcpy(b->hash, old.hash, size * sizeof(unsigned int));
+        if (old.packed_words > 0){
+            b->packed = arena_alloc(&b->store->arena, (size_t)capacity * old.packed_words * sizeof(uint64_t));
+            memcpy(b->packed, old.packed, (size_t)old.count * old.packed_words * sizeof(uint64_t));
+        }
+    }
+    else{
+        lexicon_index_bucket(b);
+        lexicon_pack_bucket(b, length);
+    }
+    b->masks = bucket_masks_alloc(b, capacity);
+    if (old.count > 0)
+        memcpy(b->masks, old.masks, (size_t)old.count * sizeof(uint32_t));
+    shared_arena_put(old.store);
+}
+
+// Paquet l pret a etre modifie en place dans la copie privee, avec la
+// place pour un mot de bytes octets
+static void bucket_own(struct bucket *b, int length, int bytes, char *owned)
+{
+    int stride = b->stride > bytes + 1 ? b->stride : bytes + 1;
+    if (owned[length] && stride == b->stride && b->count < b->capacity)
+        return;
+    int capacity = b->capacity;
+    if (b->count == capacity || stride != b->stride)
+        capacity = 2 * b->count + 16;
+    else if (b->hash != NULL && (int)(b->hash_mask + 1) / 2 > capacity)
+        capacity = (b->hash_mask + 1) / 2;
+    bucket_relayout(b, length, stride, capacity);
+    owned[length] = 1;
+}
+
+static int bucket_find(struct bucket *b, const char *word)
+{
+    int bytes = strlen(word);
+    if (b->count == 0 || bytes >= b->stride)
+        return -1;
+    unsigned int h = hash_word(word, bytes) & b->hash_mask;
+    while (b->hash[h] != 0){
+        if (strcmp(b->words + (b->hash[h] - 1) * b->stride, word) == 0)
+            return b->hash[h] - 1;
+        h = (h + 1) & b->hash_mask;
+    }
+    return -1;
+}
+
+static void bucket_append(struct bucket *b, int length, const char *word)
+{
+    int bytes = strlen(word);
+    char *dst = b->words + b->count * b->stride;
+    memset(dst, 0, b->stride);
+    memcpy(dst, word, bytes);
+    bucket_hash_insert(b, b->count);
+    b->masks[b->count] = symbol_mask(word);
+    if (b->packed_words > 0){
+        uint64_t w[2];
+        pack_word(word, length, w);
+        memcpy(b->packed + (size_t)b->count * b->packed_words, w, b->packed_words * sizeof(uint64_t));
+    }
+    else if (length <= PACKED_MAX_LENGTH && b->count == 0 && b->stride == length + 1){
+        b->count++;
+        lexicon_pack_bucket(b, length);
+        return;
+    }
+    b->count++;
+}
+
+// Retire les places vides en gardant l'ordre, et refait la table sur place
+static void bucket_compact(struct bucket *b)
+{
+    int n = 0, nb = b->packed_words;
+    for (int i = 0; i < b->count; i++){
+        if (b->words[i * b->stride] == '\0')
+            continue;
+        if (n != i){
+            memcpy(b->words + n * b->stride, b->words + i * b->stride, b->stride);
+            b->masks[n] = b->masks[i];
+            if (nb > 0)
+                memcpy(b->packed + (size_t)n * nb, b->packed + (size_t)i * nb, nb * sizeof(uint64_t));
+        }
+        n++;
+    }
+    memset(b->words + n * b->stride, 0, (size_t)(b->count - n) * b->stride);
+    b->count = n;
+    b->dead = 0;
+    memset(b->hash, 0, (b->hash_mask + 1) * sizeof(unsigned int));
+    for (int i = 0; i < n; i++)
+        bucket_hash_insert(b, i);
+}
+
+// Retire le mot index : sa case de hachage est trouvee par le hash du mot
+// et videe par decalage arriere (adressage ouvert lineaire), sa place
+// reste vide jusqu'au compactage. Les autres mots gardent leur indice et
+// leur ordre (les egalites de distance se departagent par l'ordre du fichier).
+static void bucket_remove(struct bucket *b, int index)
+{
+    char *removed = b->words + index * b->stride;
+    unsigned int j = hash_word(removed, strlen(removed)) & b->hash_mask;
+    while (b->hash[j] != (unsigned int)index + 1)
+        j = (j + 1) & b->hash_mask;
+    b->hash[j] = 0;
+    for (unsigned int k = (j + 1) & b->hash_mask; b->hash[k] != 0; k = (k + 1) & b->hash_mask){
+        char *word = b->words + (b->hash[k] - 1) * b->stride;
+        unsigned int home = hash_word(word, strlen(word)) & b->hash_mask;
+        if (((k - home) & b->hash_mask) >= ((k - j) & b->hash_mask)){
+            b->hash[j] = b->hash[k];
+            b->hash[k] = 0;
+            j = k;
+        }
+    }
+    memset(removed, 0, b->stride);
+    b->dead++;
+    if (4 * b->dead > b->count)
+        bucket_compact(b);
+}
+
+// Profil pret a etre modifie dans la copie privee : recopie a la premiere
+// modification (owned[0]), les versions publiees gardent le leur
+static void profile_own(struct lexicon *lex, char *owned)
+{
+    if (owned[0])
+        return;
+    struct shared_arena *old = lex->profile;
+    profile_alloc(lex, lex->trigram_counts);
+    shared_arena_put(old);
+    owned[0] = 1;
+}
+
+// Ajoute (remove == 0) ou retire un mot de la copie privee lex ; 1 si le
+// lexique change. owned[l] : paquet l deja recopie, owned[0] : profil
+// recopie, dont les tables sont a refaire avec profile_tables.
+static int lexicon_edit(struct lexicon *lex, const char *word, int remove, char *owned)
+{
+    int length = utf8_length(word);
+    if (length < 1 || length > LEXICON_MAX_LENGTH)
+        return 0;
+    struct bucket *b = &lex->buckets[length];
+    int index = bucket_find(b, word);
+    if ((index >= 0) != remove)
+        return 0;
+    bucket_own(b, length, strlen(word), owned);
+    profile_own(lex, owned);
+    if (remove){
+        lex->nb_trigrams -= profile_count_word(lex->trigram_counts, word, -1);
+        bucket_remove(b, index);
+    }
+    else{
+        lex->nb_trigrams += profile_count_word(lex->trigram_counts, word, 1);
+        bucket_append(b, length, word);
+    }
+    lex->nb_words += remove ? -1 : 1;
+    return 1;
+}
+
+struct live_lexicon *live_lexicon_create(const char *name, const char *prefix)
+{
+    struct lexicon *lex = lexicon_load(name, prefix);
+    if (lex == NULL)
+        return NULL;
+    struct live_lexicon *live = calloc(1, sizeof(struct live_lexicon));
+    atomic_init(&live->current, lex);
+    atomic_init(&live->epoch, 1);
+    pthread_mutex_init(&live->writer, NULL);
+    return live;
+}
+
+// Ajoute (remove == 0) ou retire nb mots d'un coup, en une seule version ;
+// renvoie le nombre de mots qui ont change le lexique
+static int live_update(struct live_lexicon *live, const char **words, int nb, int remove)
+{
+    char owned[LEXICON_MAX_LENGTH + 1] = {0};
+    int changed = 0;
+    pthread_mutex_lock(&live->writer);
+    struct lexicon *next = lexicon_clone(atomic_load(&live->current));
+    for (int i = 0; i < nb; i++){
+        size_t n = strlen(words[i]);
+        char *word = malloc(n + 1);
+        utf8_fold(word, words[i], n);
+        if (lexicon_edit(next, word, remove, owned)){
+            changed++;
+            if (live->nb_journal == live->journal_cap){
+                live->journal_cap = live->journal_cap ? 2 * live->journal_cap : 16;
+                struct live_edit *bigger = malloc(live->journal_cap * sizeof(struct live_edit));
+                if (live->nb_journal > 0)
+                    memcpy(bigger, live->journal, live->nb_journal * sizeof(struct live_edit));
+                free(live->journal);
+                live->journal = bigger;
+            }
+            live->journal[live->nb_journal].word = word;
+            live->journal[live->nb_journal].remove = remove;
+            live->nb_journal++;
+        }
+        else
+            free(word);
+    }
+    if (changed > 0){
+        profile_tables(next);
+        live_publish(live, next);
+    }
+    else
+        lexicon_free(next);
+    pthread_mutex_unlock(&live->writer);
+    return changed;
+}
+
+int live_lexicon_add(struct live_lexicon *live, const char **words, int nb)
+{
+    return live_update(live, words, nb, 0);
+}
+
+int live_lexicon_remove(struct live_lexicon *live, const char **words, int nb)
+{
+    return live_update(live, words, nb, 1);
+}
+
+// Relit les fichiers du lexique et rejoue le journal ; l'ancienne version
+// reste en place si le chargement echoue (-1)
+int live_lexicon_reload(struct live_lexicon *live)
+{
+    char owned[LEXICON_MAX_LENGTH + 1] = {0};
+    pthread_mutex_lock(&live->writer);
+    struct lexicon *current = atomic_load(&live->current);
+    struct lexicon *next = lexicon_load(current->name, current->prefix);
+    if (next == NULL){
+        pthread_mutex_unlock(&live->writer);
+        return -1;
+    }
+    for (int i = 0; i < live->nb_journal; i++)
+        lexicon_edit(next, live->journal[i].word, live->journal[i].remove, owned);
+    if (owned[0])
+        profile_tables(next);
+    live_publish(live, next);
+    pthread_mutex_unlock(&live->writer);
+    return 0;
+}
+
+// Sans lecteur en cours
+void live_lexicon_free(struct live_lexicon *live)
+{
+    lexicon_free(atomic_load(&live->current));
+    for (int i = 0; i < live->nb_journal; i++)
+        free(live->journal[i].word);
+    free(live->journal);
+    pthread_mutex_destroy(&live->writer);
+    free(live);
+}
+
+///////////////////////// PARTIE LEXIQUE COMPRESSE //////////////////////////
+/*
+    Lexique compresse pour les petites machines : chaque paquet est trie
+    (ordre des octets) et code par prefixe commun avec le mot precedent,
+    par blocs de FRONT_BLOCK mots dont le premier est entier (point de
+    reprise). Un mot code = un octet (prefixe << 4 | longueur du suffixe)
+    si les deux tiennent sur 4 bits, sinon 0xF0 puis les deux longueurs
+    sur un octet chacune ; puis le suffixe.
+    - recherche exacte : dichotomie sur les tetes de bloc puis decodage
+      d'un seul bloc ;
+    - parcours : un bloc est decode dans des lignes de largeur fixe
+      (multiple de 8, completees par des zeros) : chaque mot est la copie
+      de la ligne precedente plus son suffixe, et une ligne ASCII est
+      directement le mot compacte du raccourci de Hamming.
+    Le rang de chaque mot dans le fichier est garde (16 bits si le paquet
+    le permet) pour departager les egalites comme le lexique plat : les
+    resultats sont identiques.
+*/
+#define FRONT_BLOCK 32
+#define FRONT_ESCAPE 0xF0
+
+struct front_bucket {
+    unsigned char *data;
+    unsigned int *block_offset;     // nb_blocks + 1 debuts de bloc dans data
+    unsigned short *rank16;         // rang dans le fichier, si count <= 65536
+    unsigned int *rank32;           // sinon
+    int count;
+    int nb_blocks;
+    int row;                        // largeur d'une ligne decodee
+    int ascii;                      // lignes utilisables comme mots compactes
+    size_t bytes;                   // memoire du paquet
+};
+
+struct front_lexicon {
+    struct arena arena;
+    char name[16];
+    struct front_bucket buckets[LEXICON_MAX_LENGTH + 1];
+    int nb_words;
+};
+
+static inline unsigned int front_rank(const struct front_bucket *fb, int i)
+{
+    return fb->rank16 != NULL ? fb->rank16[i] : fb->rank32[i];
+}
+
+// En-tete d'un mot code : prefixe commun et longueur du suffixe
+static inline const unsigned char *front_header(const unsigned char *p, int *prefix, int *suffix)
+{
+    if (*p != FRONT_ESCAPE){
+        *prefix = *p >> 4;
+        *suffix = *p & 15;
+        return p + 1;
+    }
+    *prefix = p[1];
+    *suffix = p[2];
+    return p + 3;
+}
+
+// Decode n mots a partir de p dans des lignes de row octets. row est une
+// constante dans les appels de front_decode_block : la copie de la ligne
+// precedente devient quelques chargements / rangements.
+static inline void front_decode_rows(const unsigned char *p, int n, char *rows, int row)
+{
+    int previous = 0;
+    for (int k = 0; k < n; k++){
+        char *line = rows + k * row;
+        int prefix, suffix;
+        p = front_header(p, &prefix, &suffix);
+        if (k > 0)
+            memcpy(line, line - row, row);
+        else
+            memset(line, 0, row);
+        for (int j = 0; j < suffix; j++)
+            line[prefix + j] = p[j];
+        for (int j = prefix + suffix; j < previous; j++)
+            line[j] = 0;
+        previous = prefix + suffix;
+        p += suffix;
+    }
+}
+
+// Decode le bloc dans rows (FRONT_BLOCK lignes de fb->row octets) ; renvoie
+// le nombre de mots
+static int front_decode_block(const struct front_bucket *fb, int block, char *rows)
+{
+    const unsigned char *p = fb->data + fb->block_offset[block];
+    int n = fb->count - block * FRONT_BLOCK;
+    if (n > FRONT_BLOCK)
+        n = FRONT_BLOCK;
+    switch (fb->row){
+    case 8:
+        front_decode_rows(p, n, rows, 8);
+        break;
+    case 16:
+        front_decode_rows(p, n, rows, 16);
+        break;
+    case 24:
+        front_decode_rows(p, n, rows, 24);
+        break;
+    default:
+        front_decode_rows(p, n, rows, fb->row);
+    }
+    return n;
+}
+
+struct front_entry {
+    const char *word;
+    unsigned int rank;
+};
+
+static int front_entry_cmp(const void *a, const void *b)
+{
+    const struct front_entry *x = a, *y = b;
+    int c = strcmp(x->word, y->word);
+    if (c != 0)
+        return c;
+    return x->rank < y->rank ? -1 : x->rank > y->rank;
+}
+
+static void front_build_bucket(struct front_lexicon *fl, struct bucket *b, struct front_bucket *fb)
+{
+    struct arena_mark mark = arena_mark(&thread_arena);
+    struct front_entry *entries = arena_alloc(&thread_arena, (b->count + 1) * sizeof(struct front_entry));
+    int n = 0, max_bytes = 0;
+    fb->ascii = 1;
+    for (int i = 0; i < b->count; i++){
+        const char *word = b->words + i * b->stride;
+        int bytes = strlen(word);
+        if (bytes == 0 || bytes > 255)
+            continue;
+        for (int k = 0; k < bytes; k++)
+            fb->ascii &= (unsigned char)word[k] < 0x80;
+        if (bytes > max_bytes)
+            max_bytes = bytes;
+        entries[n].word = word;
+        entries[n].rank = i;
+        n++;
+    }
+    qsort(entries, n, sizeof(struct front_entry), front_entry_cmp);
+
+    fb->count = n;
+    fb->nb_blocks = (n + FRONT_BLOCK - 1) / FRONT_BLOCK;
+    fb->row = (max_bytes + 1 + 7) & ~7;
+    size_t size = 0;
+    for (int i = 0; i < n; i++){
+        int bytes = strlen(entries[i].word), prefix = 0;
+        if (i % FRONT_BLOCK != 0){
+            const char *previous = entries[i - 1].word;
+            while (prefix < bytes && previous[prefix] == entries[i].word[prefix])
+                prefix++;
+        }
+        size += (prefix < 15 && bytes - prefix < 16 ? 1 : 3) + bytes - prefix;
+    }
+    fb->data = arena_alloc(&fl->arena, size + 1);
+    fb->block_offset = arena_alloc(&fl->arena, (fb->nb_blocks + 1) * sizeof(unsigned int));
+    if (b->count <= 65536)
+        fb->rank16 = arena_alloc(&fl->arena, (n + 1) * sizeof(unsigned short));
+    else
+        fb->rank32 = arena_alloc(&fl->arena, (n + 1) * sizeof(unsigned int));
+    unsigned char *p = fb->data;
+    for (int i = 0; i < n; i++){
+        int bytes = strlen(entries[i].word), prefix = 0;
+        if (i % FRONT_BLOCK == 0)
+            fb->block_offset[i / FRONT_BLOCK] = p - fb->data;
+        else{
+            const char *previous = entries[i - 1].word;
+            while (prefix < bytes && previous[prefix] == entries[i].word[prefix])
+                prefix++;
+        }
+        int suffix = bytes - prefix;
+        if (prefix < 15 && suffix < 16)
+            *p++ = prefix << 4 | suffix;
+        else{
+            *p++ = FRONT_ESCAPE;
+            *p++ = prefix;
+            *p++ = suffix;
+        }
+        memcpy(p, entries[i].word + prefix, suffix);
+        p += suffix;
+        if (fb->rank16 != NULL)
+            fb->rank16[i] = entries[i].rank;
+        else
+            fb->rank32[i] = entries[i].rank;
+    }
+    fb->block_offset[fb->nb_blocks] = p - fb->data;
+    fb->bytes = size + (fb->nb_blocks + 1) * sizeof(unsigned int) + n * (fb->rank16 != NULL ? sizeof(unsigned short) : sizeof(unsigned int));
+    arena_release(&thread_arena, mark);
+}
+
+// Version compressee d'un lexique charge (lex peut etre libere ensuite)
+struct front_lexicon *front_lexicon_build(struct lexicon *lex)
+{
+    struct front_lexicon *fl = calloc(1, sizeof(struct front_lexicon));
+    memcpy(fl->name, lex->name, sizeof(fl->name));
+    for (int l = 1; l <= LEXICON_MAX_LENGTH; l++){
+        if (lex->buckets[l].count == 0)
+            continue;
+        front_build_bucket(fl, &lex->buckets[l], &fl->buckets[l]);
+        fl->nb_words += fl->buckets[l].count;
+    }
+    return fl;
+}
+
+// Charge prefix + N + ".txt" directement sous forme compressee
+struct front_lexicon *front_lexicon_load(const char *name, const char *prefix)
+{
+    struct lexicon *lex = lexicon_load(name, prefix);
+    if (lex == NULL)
+        return NULL;
+    struct front_lexicon *fl = front_lexicon_build(lex);
+    lexicon_free(lex);
+    return fl;
+}
+
+void front_lexicon_free(struct front_lexicon *fl)
+{
+    arena_free(&fl->arena);
+    free(fl);
+}
+
+// Comme lexicon_exist : 0 si trop court, 1 si present, 2 sinon
+int front_exist(struct front_lexicon *fl, const char *word)
+{
+    int l_word = utf8_length(word);
+    if (l_word < 3)
+        return 0;
+    if (l_word > LEXICON_MAX_LENGTH)
+        return 2;
+    struct front_bucket *fb = &fl->buckets[l_word];
+    if (fb->count == 0 || (int)strlen(word) >= fb->row)
+        return 2;
+    // dernier bloc dont la tete est <= word ; une tete est stockee entiere
+    int lo = 0, hi = fb->nb_blocks - 1;
+    char head[256];
+    while (lo < hi){
+        int mid = (lo + hi + 1) / 2;
+        int prefix, suffix;
+        const unsigned char *p = front_header(fb->data + fb->block_offset[mid], &prefix, &suffix);
+        memcpy(head, p, suffix);
+        head[suffix] = '\0';
+        if (strcmp(head, word) <= 0)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    char rows[FRONT_BLOCK * 256];
+    int n = front_decode_block(fb, lo, rows);
+    for (int k = 0; k < n; k++){
+        int c = strcmp(rows + k * fb->row, word);
+        if (c == 0)
+            return 1;
+        if (c > 0)
+            break;
+    }
+    return 2;
+}
+
+// Hamming des lignes decodees contre le mot compacte, lignes ASCII seulement
+static void front_hamming_rows(const struct front_bucket *fb, const char *rows, int n, struct packed_query *pq, int nb_words, unsigned char *hamming)
+{
+    for (int k = 0; k < n; k++){
+        uint64_t w[2] = {0, 0};
+        memcpy(w, rows + k * fb->row, nb_words * sizeof(uint64_t));
+        hamming[k] = nonzero_bytes(w[0] ^ pq->word[0]) + nonzero_bytes(w[1] ^ pq->word[1]);
+    }
+}
+
+// Prepare le raccourci de Hamming (plus == 0, paquet et mot ASCII <= 16)
+static int front_pack_query(const struct front_bucket *fb, const char *word, int length, int plus, struct packed_query *pq)
+{
+    pq->ok = 0;
+    if (plus != 0 || !fb->ascii || length > PACKED_MAX_LENGTH || (int)strlen(word) != length)
+        return 0;
+    pack_word(word, length, pq->word);
+    pq->ok = 1;
+    return length > 8 ? 2 : 1;
+}
+
+// Comme lexicon_correction, sur la forme compressee. Les mots sont vus dans
+// l'ordre trie : les egalites passent par un tie_set sur le rang dans le
+// fichier, et le mot retenu est redecode a la fin.
+char* front_correction(struct front_lexicon *fl, char* ocr_word, int nb, int plus) // thread_arena
+{
+    int l_word = utf8_length(ocr_word);
+    if (l_word < 3 || l_word + plus < 1 || l_word + plus > LEXICON_MAX_LENGTH || nb < 0)
+        return arena_strdup(&thread_arena, ocr_word);
+    struct front_bucket *fb = &fl->buckets[l_word + plus];
+    if (fb->count == 0)
+        return arena_strdup(&thread_arena, ocr_word);
+    struct tie_set ties;
+    tie_set_init(&ties, nb + 1, arena_alloc(&thread_arena, (nb + 1) * sizeof(unsigned int)),
+                 arena_alloc(&thread_arena, (nb + 1) * sizeof(int)));
+    char rows[FRONT_BLOCK * 256];
+    unsigned char hamming[FRONT_BLOCK];
+    struct packed_query pq;
+    int nb_packed = front_pack_query(fb, ocr_word, l_word, plus, &pq);
+    for (int block = 0; block < fb->nb_blocks; block++){
+        int n = front_decode_block(fb, block, rows);
+        if (pq.ok)
+            front_hamming_rows(fb, rows, n, &pq, nb_packed, hamming);
+        for (int k = 0; k < n; k++){
+            unsigned int rank = front_rank(fb, block * FRONT_BLOCK + k);
+            unsigned int h = pq.ok ? hamming[k] : 0;
+            unsigned int distance = candidate_distance(rows + k * fb->row, ocr_word, &pq, h, ties.min_dist, tie_set_open(&ties, rank));
+            tie_set_add(&ties, distance, rank, block * FRONT_BLOCK + k);
+        }
+    }
+    if (ties.count == 0)
+        return arena_strdup(&thread_arena, ocr_word);
+    int item = ties.item[ties.count - 1];
+    front_decode_block(fb, item / FRONT_BLOCK, rows);
+    return arena_strdup(&thread_arena, rows + (item % FRONT_BLOCK) * fb->row);
+}
+
+// Comme lexicon_nb_solutions, sur la forme compressee
+int front_nb_solutions(struct front_lexicon *fl, char* word, int plus)
+{
+    int l_word = utf8_length(word);
+    if (l_word < 3 || l_word + plus < 1 || l_word + plus > LEXICON_MAX_LENGTH)
+        return 0;
+    struct front_bucket *fb = &fl->buckets[l_word + plus];
+    struct tie_scan t;
+    tie_scan_init(&t, fb->count);
+    char rows[FRONT_BLOCK * 256];
+    unsigned char hamming[FRONT_BLOCK];
+    struct packed_query pq;
+    int nb_packed = front_pack_query(fb, word, l_word, plus, &pq);
+    for (int block = 0; block < fb->nb_blocks; block++){
+        int n = front_decode_block(fb, block, rows);
+        if (pq.ok)
+            front_hamming_rows(fb, rows, n, &pq, nb_packed, hamming);
+        for (int k = 0; k < n; k++){
+            unsigned int h = pq.ok ? hamming[k] : 0;
+            tie_scan_add(&t, candidate_distance(rows + k * fb->row, word, &pq, h, t.min_dist, 1), block * FRONT_BLOCK + k);
+        }
+    }
+    return t.count;
+}
+
+/////////////////////// PARTIE CORRECTION PAR LOT //////////////////////////
+/*
+    Au lieu d'un parcours du paquet par token, on corrige tous les tokens
+    inconnus du document ensemble : ils sont dedoublonnes, ranges par paquet
+    cible (longueur + plus), puis chaque paquet est lu une seule fois, par
+    blocs de BATCH_BLOCK mots qui restent en cache pendant qu'on les compare
+    a toutes les requetes en attente. Chaque requete voit les mots dans le
+    meme ordre que correction(), donc le resultat est le meme.
+*/
+
+#define BATCH_BLOCK 512
+
+struct query {
+    const char *word;       // en minuscules
+    int nb;                 // comme correction(word, nb, plus)
+    int plus;
+    struct tie_scan tie;    // tie.best : indice dans le paquet, -1 si aucun
+};
+
+void query_init(struct query *q, const char *word, int nb, int plus)
+{
+    q->word = word;
+    q->nb = nb;
+    q->plus = plus;
+    tie_scan_init(&q->tie, nb);
+}
+
+// Mot retenu pour q (dans le lexique), ou le mot lui-meme
+const char *query_result(struct lexicon *lex, struct query *q)
+{
+    if (q->tie.best < 0)
+        return q->word;
+    struct bucket *b = &lex->buckets[utf8_length(q->word) + q->plus];
+    return b->words + q->tie.best * b->stride;
+}
+
+void lexicon_correction_batch(struct lexicon *lex, struct query *queries, int nb_queries)
+{
+    struct arena_mark mark = arena_mark(&thread_arena);
+    int *target = arena_alloc(&thread_arena, (nb_queries + 1) * sizeof(int));
+    int *order = arena_alloc(&thread_arena, (nb_queries + 1) * sizeof(int));
+    int first[LEXICON_MAX_LENGTH + 2] = {0};
+    int q, l;
+
+    // tri par paquet cible (tri par denombrement, stable)
+    for (q = 0; q < nb_queries; q++){
+        int l_word = utf8_length(queries[q].word);
+        target[q] = l_word + queries[q].plus;
+        if (l_word < 3 || target[q] < 1 || target[q] > LEXICON_MAX_LENGTH)
+            target[q] = 0;
+        first[target[q] + 1]++;
+    }
+    for (l = 1; l <= LEXICON_MAX_LENGTH + 1; l++)
+        first[l] += first[l - 1];
+    for (q = 0; q < nb_queries; q++)
+        order[first[target[q]]++] = q;
+    for (l = LEXICON_MAX_LENGTH + 1; l > 0; l--)
+        first[l] = first[l - 1];
+    first[0] = 0;
+
+    for (l = 1; l <= LEXICON_MAX_LENGTH; l++){
+        struct bucket *b = &lex->buckets[l];
+        if (first[l] == first[l + 1] || b->count == 0)
+            continue;
+        for (int start = 0; start < b->count; start += BATCH_BLOCK){
+            int end = start + BATCH_BLOCK < b->count ? start + BATCH_BLOCK : b->count;
+            for (int k = first[l]; k < first[l + 1]; k++){
+                struct query *qr = &queries[order[k]];
+                struct packed_query pq;
+                pack_query(b, qr->word, qr->plus, &pq);
+                bucket_scan(b, qr->word, &pq, start, end, &qr->tie);
+            }
+        }
+    }
+    arena_release(&thread_arena, mark);
+}
+
+// Comme first_file, mais en deux temps : lecture et dedoublonnage des mots
+// inconnus, une correction par lot sur le lexique par defaut, puis ecriture.
+// Les dechets sont recopies tels quels, junk (si non NULL) recoit les comptes.
+void first_file_batch(char* filename, struct junk_stats *junk)
+{
+    struct lexicon *lex = default_lexicon();
+    FILE* file = fopen(filename,"r");
+    if (lex == NULL || file == NULL){
+        if (file != NULL)
+            fclose(file);
+        return;
+    }
+    struct arena arena = {NULL, NULL};
+    fseek(file, 0, SEEK_END);
+    size_t len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *text = arena_alloc(&arena, len + 1);
+    len = fread(text, 1, len, file);
+    fclose(file);
+
+    // tokens : mot en minuscules et indice de sa requete (-1 si connu)
+    int nb_tokens = 0;
+    size_t i = 0;
+    while (i < len){
+        size_t n = utf8_word_char(text, len, i);
+        if (n == 0){
+            i++;
+            continue;
+        }
+        nb_tokens++;
+        while (n > 0){
+            i += n;
+            n = i < len ? utf8_word_char(text, len, i) : 0;
+        }
+    }
+    size_t *token_start = arena_alloc(&arena, (nb_tokens + 1) * sizeof(size_t));
+    size_t *token_end = arena_alloc(&arena, (nb_tokens + 1) * sizeof(size_t));
+    int *token_query = arena_alloc(&arena, (nb_tokens + 1) * sizeof(int));
+    char *token_junk = arena_alloc(&arena, nb_tokens + 1);
+    char **token_word = arena_alloc(&arena, (nb_tokens + 1) * sizeof(char *));
+    struct query *queries = arena_alloc(&arena, (nb_tokens + 1) * sizeof(struct query));
+    unsigned int hash_size = 16;
+    while (hash_size < 2 * (unsigned int)nb_tokens)
+        hash_size *= 2;
+    int *hash = arena_alloc(&arena, hash_size * sizeof(int));
+    memset(hash, -1, hash_size * sizeof(int));
+    int nb_queries = 0;
+    int t = 0;
+    i = 0;
+    while (i < len){
+        size_t n = utf8_word_char(text, len, i);
+        if (n == 0){
+            i++;
+            continue;
+        }
+        token_start[t] = i;
+        while (n > 0){
+            i += n;
+            n = i < len ? utf8_word_char(text, len, i) : 0;
+        }
+        token_end[t] = i;
+        char *word = arena_alloc(&arena, i - token_start[t] + 1);
+        utf8_fold(word, text + token_start[t], i - token_start[t]);
+        token_query[t] = -1;
+        token_junk[t] = 0;
+        if (lexicon_exist(lex, word) == 2 && junk_count(lex, word, junk) != JUNK_NONE)
+            token_junk[t] = 1;
+        else if (lexicon_exist(lex, word) == 2){
+            unsigned int h = hash_word(word, strlen(word)) & (hash_size - 1);
+            while (hash[h] >= 0 && strcmp(queries[hash[h]].word, word) != 0)
+                h = (h + 1) & (hash_size - 1);
+            if (hash[h] < 0){
+                hash[h] = nb_queries;
+                query_init(&queries[nb_queries++], word, 0, 0);
+            }
+            token_query[t] = hash[h];
+        }
+        token_word[t] = word;
+        t++;
+    }
+
+    lexicon_correction_batch(lex, queries, nb_queries);
+
+    char* start = "c_";
+    char *filename_dupli = arena_alloc(&arena, strlen(start) + strlen(filename) + 1);
+    strcpy(filename_dupli, start);
+    strcat(filename_dupli, filename);
+    FILE* file_dupli = fopen(filename_dupli,"w");
+    if (file_dupli != NULL){
+        size_t written = 0;
+        char t_word[4 * LEXICON_MAX_LENGTH + 1];
+        for (t = 0; t < nb_tokens; t++){
+            fwrite(text + written, 1, token_start[t] - written, file_dupli);
+            size_t n = token_end[t] - token_start[t];
+            if (n > 4 * LEXICON_MAX_LENGTH || token_junk[t]){
+                fwrite(text + token_start[t], 1, n, file_dupli);
+            }
+            else{
+                if (token_query[t] < 0)
+                    strcpy(t_word, token_word[t]);
+                else
+                    strcpy(t_word, query_result(lex, &queries[token_query[t]]));
+                if (utf8_first_upper(text + token_start[t], n))
+                    utf8_upper_first(t_word);
+                fputs(t_word, file_dupli);
+            }
+            written = token_end[t];
+        }
+        fwrite(text + written, 1, len - written, file_dupli);
+        fclose(file_dupli);
+    }
+    arena_free(&arena);
+}
+
+/////////////////////////// PARTIE PIPELINE /////////////////////////////////
+/*
+    Execution en trois etages : un lecteur decoupe le fichier en blocs (sur
+    une frontiere de mot), un groupe de correcteurs corrige les blocs, un
+    ecrivain les remet dans l'ordre et les ecrit. Chaque correcteur a une file
+    d'entree et une file de sortie SPSC sans verrou ; le lecteur distribue
+    les blocs a tour de role et l'ecrivain les reprend dans le meme ordre,
+    ce qui suffit a garder l'ordre du fichier. Les blocs viennent d'une
+    reserve fixe que l'ecrivain rend au lecteur par une derniere file : une
+    file pleine bloque l'etage qui la remplit (contre-pression).
+*/
+
+#define PIPELINE_MAX_WORKERS 16
+#define PIPELINE_RING 8             // blocs par file, puissance de 2
+#define PIPELINE_BLOCK 2048         // octets lus par bloc
+
+struct ring {
+    _Atomic size_t head;            // ecrit par le consommateur
+    char pad_head[64 - sizeof(size_t)];
+    _Atomic size_t tail;            // ecrit par le producteur
+    char pad_tail[64 - sizeof(size_t)];
+    size_t mask;
+    void **slots;
+    unsigned long fill_sum;         // occupation vue par le producteur
+    unsigned long fill_samples;
+};
+
+struct block {
+    long seq;
+    int last;                       // bloc de fin, sans texte
+    char *text;
+    size_t len;
+    char *out;
+    size_t out_len;
+    size_t out_cap;
+    struct junk_stats junk;         // dechets du bloc, cumules par l'ecrivain
+};
+
+struct stage_stats {
+    unsigned long items;
+    unsigned long stalls;           // essais sur une file pleine ou vide
+    double busy;                    // secondes de travail
+    double waiting;                 // secondes bloque sur une file
+};
+
+struct pipeline_stats {
+    int nb_workers;
+    double elapsed;
+    struct stage_stats reader;
+    struct stage_stats writer;
+    struct stage_stats workers[PIPELINE_MAX_WORKERS];
+    double in_fill[PIPELINE_MAX_WORKERS];   // occupation moyenne des files, 0..1
+    double out_fill[PIPELINE_MAX_WORKERS];
+    struct junk_stats junk;
+};
+
+struct pipeline {
+    struct lexicon *lex;
+    struct live_lexicon *live;      // si non NULL, version relue a chaque bloc
+    int nb_workers;
+    struct ring in[PIPELINE_MAX_WORKERS];
+    struct ring out[PIPELINE_MAX_WORKERS];
+    struct ring free_blocks;
+    struct pipeline_stats *stats;
+};
+
+struct worker_arg {
+    struct pipeline *pipe;
+    int id;
+};
+
+static double now_seconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void ring_init(struct ring *r, size_t capacity, void **slots)
+{
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    r->mask = capacity - 1;
+    r->slots = slots;
+    r->fill_sum = 0;
+    r->fill_samples = 0;
+}
+
+static int ring_push(struct ring *r, void *item)
+{
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    if (tail - head > r->mask)
+        return 0;
+    r->slots[tail & r->mask] = item;
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+    r->fill_sum += tail + 1 - head;
+    r->fill_samples++;
+    return 1;
+}
+
+static void *ring_pop(struct ring *r)
+{
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    if (head == tail)
+        return NULL;
+    void *item = r->slots[head & r->mask];
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+    return item;
+}
+
+// Attente active (avec sched_yield) tant que la file est pleine
+static void ring_push_wait(struct ring *r, void *item, struct stage_stats *st)
+{
+    if (ring_push(r, item))
+        return;
+    double start = now_seconds();
+    while (!ring_push(r, item)){
+        st->stalls++;
+        sched_yield();
+    }
+    st->waiting += now_seconds() - start;
+}
+
+static void *ring_pop_wait(struct ring *r, struct stage_stats *st)
+{
+    void *item = ring_pop(r);
+    if (item != NULL)
+        return item;
+    double start = now_seconds();
+    while ((item = ring_pop(r)) == NULL){
+        st->stalls++;
+        sched_yield();
+    }
+    st->waiting += now_seconds() - start;
+    return item;
+}
+
+static void block_output(struct block *b, const char *str, size_t n)
+{
+    if (b->out_len + n > b->out_cap){
+        size_t cap = 2 * (b->out_len + n);
+        char *bigger = malloc(cap);
+        memcpy(bigger, b->out, b->out_len);
+        free(b->out);
+        b->out = bigger;
+        b->out_cap = cap;
+    }
+    memcpy(b->out + b->out_len, str, n);
+    b->out_len += n;
+}
+
+// Corrige un bloc comme first_file : mots repliees en minuscules, premiere
+// lettre remise en majuscule, separateurs recopies tels quels.
+static void block_correct(struct lexicon *lex, struct block *b)
+{
+    size_t i = 0;
+    b->out_len = 0;
+    memset(&b->junk, 0, sizeof(struct junk_stats));
+    while (i < b->len){
+        size_t n = utf8_word_char(b->text, b->len, i);
+        if (n == 0){
+            block_output(b, b->text + i, 1);
+            i++;
+            continue;
+        }
+        struct arena_mark mark = arena_mark(&thread_arena);
+        size_t w = i;
+        while (n > 0){
+            i += n;
+            n = i < b->len ? utf8_word_char(b->text, b->len, i) : 0;
+        }
+        char *word = arena_alloc(&thread_arena, i - w + 1);
+        utf8_fold(word, b->text + w, i - w);
+        char *t_word = word;
+        if (lexicon_exist(lex, word) == 2){
+            if (junk_count(lex, word, &b->junk) != JUNK_NONE){
+                block_output(b, b->text + w, i - w);
+                arena_release(&thread_arena, mark);
+                continue;
+            }
+            t_word = lexicon_correction(lex, word, 0, 0);
+        }
+        if (utf8_first_upper(b->text + w, i - w))
+            utf8_upper_first(t_word);
+        block_output(b, t_word, strlen(t_word));
+        arena_release(&thread_arena, mark);
+    }
+}
+
+static void *pipeline_worker(void *arg)
+{
+    struct worker_arg *wa = arg;
+    struct pipeline *pipe = wa->pipe;
+    struct stage_stats *st = &pipe->stats->workers[wa->id];
+    for (;;){
+        struct block *b = ring_pop_wait(&pipe->in[wa->id], st);
+        if (!b->last){
+            double start = now_seconds();
+            int slot = 0;
+            struct lexicon *lex = pipe->live != NULL ? live_read_lock(pipe->live, &slot) : pipe->lex;
+            block_correct(lex, b);
+            if (pipe->live != NULL)
+                live_read_unlock(pipe->live, slot);
+            st->busy += now_seconds() - start;
+            st->items++;
+        }
+        ring_push_wait(&pipe->out[wa->id], b, st);
+        if (b->last)
+            break;
+    }
+    arena_free(&thread_arena);
+    return NULL;
+}
+
+struct writer_arg {
+    struct pipeline *pipe;
+    FILE *file;
+};
+
+static void *pipeline_writer(void *arg)
+{
+    struct writer_arg *wa = arg;
+    struct pipeline *pipe = wa->pipe;
+    struct stage_stats *st = &pipe->stats->writer;
+    for (long seq = 0;; seq++){
+        struct block *b = ring_pop_wait(&pipe->out[seq % pipe->nb_workers], st);
+        if (b->last)
+            break;
+        double start = now_seconds();
+        fwrite(b->out, 1, b->out_len, wa->file);
+        pipe->stats->junk.checked += b->junk.checked;
+        for (int r = 0; r < JUNK_REASONS; r++)
+            pipe->stats->junk.rejected[r] += b->junk.rejected[r];
+        st->busy += now_seconds() - start;
+        st->items++;
+        ring_push_wait(&pipe->free_blocks, b, st);
+    }
+    return NULL;
+}
+
+// Longueur du debut de text[0..len) qui finit sur un separateur ASCII :
+// aucun mot (ni caractere UTF-8) n'est coupe entre deux blocs.
+// Coupe d'un bloc : apres le dernier caractere qui n'est pas une lettre,
+// pour ne pas couper de mot. Si le reste depasserait max_carry (un mot plus
+// long que le bloc), on coupe au debut du dernier caractere, pour ne jamais
+// couper une sequence UTF-8.
+static size_t block_cut(const char *text, size_t len, size_t max_carry)
+{
+    size_t cut = len;
+    while (cut > 0 && len - cut <= max_carry){
+        size_t start = cut - 1;
+        while (start > 0 && cut - start < 4 && ((unsigned char)text[start] & 0xC0) == 0x80)
+            start--;
+        size_t next = start;
+        unsigned int cp = utf8_decode(text, cut, &next);
+        if (next != cut){
+            // sequence coupee par la lecture, ou octet isole : pas une coupe
+            cut--;
+            continue;
+        }
+        if (!is_word_codepoint(cp))
+            return cut;
+        cut = start;
+    }
+    // debut du dernier caractere, complet ou non
+    cut = len - 1;
+    while (cut > 0 && len - cut < 4 && ((unsigned char)text[cut] & 0xC0) == 0x80)
+        cut--;
+    return cut > 0 ? cut : len;
+}
+
+// Comme first_file, avec nb_workers correcteurs en parallele sur le lexique
+// vivant live, ou le lexique par defaut si live est NULL. stats (si non
+// NULL) recoit l'occupation de chaque etage.
+void first_file_pipeline_live(char* filename, struct live_lexicon *live, int nb_workers, struct pipeline_stats *stats)
+{
+    struct lexicon *lex = live == NULL ? default_lexicon() : NULL;
+    struct pipeline_stats local_stats;
+    if (stats == NULL)
+        stats = &local_stats;
+    memset(stats, 0, sizeof(struct pipeline_stats));
+    if (nb_workers < 1)
+        nb_workers = 1;
+    if (nb_workers > PIPELINE_MAX_WORKERS)
+        nb_workers = PIPELINE_MAX_WORKERS;
+    stats->nb_workers = nb_workers;
+
+    char* start = "c_";
+    char *filename_dupli = malloc(strlen(start) + strlen(filename) + 1);
+    strcpy(filename_dupli, start);
+    strcat(filename_dupli, filename);
+    FILE* file = fopen(filename,"r");
+    FILE* file_dupli = fopen(filename_dupli,"w");
+    free(filename_dupli);
+    if ((lex == NULL && live == NULL) || file == NULL || file_dupli == NULL){
+        if (file != NULL)
+            fclose(file);
+        if (file_dupli != NULL)
+            fclose(file_dupli);
+        return;
+    }
+    double t0 = now_seconds();
+
+    // reserve de blocs : de quoi remplir toutes les files, plus un en cours
+    // par etage ; les blocs de fin sont a part
+    struct arena arena = {NULL, NULL};
+    struct pipeline pipe;
+    pipe.lex = lex;
+    pipe.live = live;
+    pipe.nb_workers = nb_workers;
+    pipe.stats = stats;
+    int nb_blocks = nb_workers * (2 * PIPELINE_RING + 1) + 2;
+    size_t free_cap = 1;
+    while (free_cap < (size_t)nb_blocks)
+        free_cap *= 2;
+    ring_init(&pipe.free_blocks, free_cap, arena_alloc(&arena, free_cap * sizeof(void *)));
+    for (int w = 0; w < nb_workers; w++){
+        ring_init(&pipe.in[w], PIPELINE_RING, arena_alloc(&arena, PIPELINE_RING * sizeof(void *)));
+        ring_init(&pipe.out[w], PIPELINE_RING, arena_alloc(&arena, PIPELINE_RING * sizeof(void *)));
+    }
+    struct block *blocks = arena_alloc(&arena, (nb_blocks + nb_workers) * sizeof(struct block));
+    for (int k = 0; k < nb_blocks + nb_workers; k++){
+        memset(&blocks[k], 0, sizeof(struct block));
+        if (k < nb_blocks){
+            blocks[k].text = arena_alloc(&arena, 2 * PIPELINE_BLOCK);
+            blocks[k].out_cap = 2 * PIPELINE_BLOCK;
+            blocks[k].out = malloc(blocks[k].out_cap);
+            ring_push(&pipe.free_blocks, &blocks[k]);
+        }
+    }
+    pipe.free_blocks.fill_sum = 0;
+    pipe.free_blocks.fill_samples = 0;
+
+    pthread_t workers[PIPELINE_MAX_WORKERS], writer;
+    struct worker_arg args[PIPELINE_MAX_WORKERS];
+    struct writer_arg warg = {&pipe, file_dupli};
+    for (int w = 0; w < nb_workers; w++){
+        args[w].pipe = &pipe;
+        args[w].id = w;
+        pthread_create(&workers[w], NULL, pipeline_worker, &args[w]);
+    }
+    pthread_create(&writer, NULL, pipeline_writer, &warg);
+
+    // lecteur : le reste d'un bloc apres la coupe passe au suivant
+    char carry[PIPELINE_BLOCK];
+    size_t carry_len = 0;
+    long seq = 0;
+    for (;;){
+        struct block *b = ring_pop_wait(&pipe.free_blocks, &stats->reader);
+        double t = now_seconds();
+        memcpy(b->text, carry, carry_len);
+        size_t n = fread(b->text + carry_len, 1, PIPELINE_BLOCK, file);
+        size_t len = carry_len + n;
+        size_t cut = n == 0 ? len : block_cut(b->text, len, sizeof(carry));
+        carry_len = len - cut;
+        memcpy(carry, b->text + cut, carry_len);
+        b->len = cut;
+        b->seq = seq;
+        stats->reader.busy += now_seconds() - t;
+        if (cut == 0)
+            break;
+        stats->reader.items++;
+        ring_push_wait(&pipe.in[seq % nb_workers], b, &stats->reader);
+        seq++;
+    }
+    // un bloc de fin par correcteur, dans l'ordre ou l'ecrivain les attend
+    for (int k = 0; k < nb_workers; k++){
+        struct block *end = &blocks[nb_blocks + k];
+        end->last = 1;
+        ring_push_wait(&pipe.in[(seq + k) % nb_workers], end, &stats->reader);
+    }
+    for (int w = 0; w < nb_workers; w++)
+        pthread_join(workers[w], NULL);
+    pthread_join(writer, NULL);
+
+    for (int w = 0; w < nb_workers; w++){
+        struct ring *in = &pipe.in[w], *out = &pipe.out[w];
+        stats->in_fill[w] = in->fill_samples ? (double)in->fill_sum / in->fill_samples / PIPELINE_RING : 0;
+        stats->out_fill[w] = out->fill_samples ? (double)out->fill_sum / out->fill_samples / PIPELINE_RING : 0;
+    }
+    for (int k = 0; k < nb_blocks; k++)
+        free(blocks[k].out);
+    arena_free(&arena);
+    fclose(file);
+    fclose(file_dupli);
+    stats->elapsed = now_seconds() - t0;
+}
+
+void first_file_pipeline(char* filename, int nb_workers, struct pipeline_stats *stats)
+{
+    first_file_pipeline_live(filename, NULL, nb_workers, stats);
+}
+
+static void print_stage(const char *name, struct stage_stats *st, double elapsed)
+{
+    printf("%-12s %8lu blocs  travail %5.1f%%  attente %5.1f%%  (%lu essais)\n", name, st->items,
+           elapsed > 0 ? 100 * st->busy / elapsed : 0, elapsed > 0 ? 100 * st->waiting / elapsed : 0, st->stalls);
+}
+
+// L'etage le plus occupe est le goulot ; des files d'entree pleines
+// (occupation proche de 100%) montrent que les correcteurs ne suivent pas.
+void print_pipeline_stats(struct pipeline_stats *stats)
+{
+    char name[32];
+    printf("pipeline : %d correcteurs, %.3f s\n", stats->nb_workers, stats->elapsed);
+    print_stage("lecteur", &stats->reader, stats->elapsed);
+    for (int w = 0; w < stats->nb_workers; w++){
+        snprintf(name, sizeof(name), "correcteur %d", w);
+        print_stage(name, &stats->workers[w], stats->elapsed);
+        printf("%12s file entree %5.1f%%  file sortie %5.1f%%\n", "", 100 * stats->in_fill[w], 100 * stats->out_fill[w]);
+    }
+    print_stage("ecrivain", &stats->writer, stats->elapsed);
+    print_junk_stats(&stats->junk);
+}
+
+/////////////////////////// PARTIE SEGMENTATION //////////////////////////////
+/*
+    Espaces perdus ou en trop ("thisis", "cor rection") : on corrige par
+    ilots, un ilot etant une suite de mots separes seulement par des
+    espaces. Un ilot d'un seul mot connu est recopie tel quel. Sinon, une
+    programmation dynamique (Viterbi) sur ses lettres choisit le decoupage
+    le moins cher en morceaux. Chaque mot ecrit coute son "prix" : le
+    dictionnaire n'a pas de frequences, on prend SEG_COMMON pour les mots
+    les plus frequents (seg_common, une probabilite d'unigramme grossiere),
+    1 pour les autres, + SEG_SHORT pour un mot rare d'au plus
+    SEG_SHORT_LENGTH lettres (le lexique contient toutes les lettres et des
+    centaines de mots de 2 ou 3 lettres : presque tout mot faux se coupe
+    en mots "connus" mais rares, "prob lme" ; un tel mot dans le texte
+    est aussi suspect, "cor rection"). Un morceau est :
+    - un mot d'origine : son prix s'il est connu, le prix de sa meilleure
+      correction + SEG_EDIT * distance s'il est inconnu (il sort corrige).
+      Deux lettres voisines echangees comptent pour une faute (2 pour
+      Levenshtein) : le mot echange du lexique passe avant les autres
+      corrections a distance 2 ;
+    - un morceau du lexique qui n'est pas un mot d'origine, de
+      SEG_MIN_PIECE lettres au moins et a cheval sur au plus SEG_WINDOW
+      mots : son prix + SEG_CHANGE par espace retire ou ajoute. S'il ne
+      touche aucun mot inconnu, ce ne peut etre que la fusion de mots
+      connus entiers, + SEG_KNOWN par espace retire.
+    Les mots connus ne sont jamais coupes. Avec ces couts "thisis" donne
+    "this is" et non "thesis", "problme" donne "problem", "cor rection"
+    donne "correction" mais "black bird" et "a lot" restent. Chaque
+    position ne
+    regarde que LEXICON_MAX_LENGTH morceaux, recherches exactes par le
+    hash sans copie : le cout reste lineaire en la longueur du texte.
+*/
+#define SEG_WINDOW 3
+#define SEG_MIN_PIECE 2
+#define SEG_EDIT 1.5f
+#define SEG_CHANGE 0.6f
+#define SEG_COMMON 0.3f
+#define SEG_SHORT 1.0f
+#define SEG_SHORT_LENGTH 3
+#define SEG_KNOWN 1.0f
+
+// Mots anglais les plus frequents, tries (strcmp) pour la dichotomie
+static const char *seg_common[] = {
+    "a", "about", "after", "all", "also", "an", "and", "any", "are", "as",
+    "at", "be", "been", "but", "by", "can", "could", "day", "did", "do",
+    "end", "far", "few", "for", "from", "get", "go", "had", "has", "have",
+    "he", "her", "him", "his", "how", "i", "if", "in", "into", "is", "it",
+    "its", "just", "let", "like", "made", "man", "may", "me", "more",
+    "most", "my", "new", "no", "not", "now", "of", "off", "old", "on",
+    "one", "only", "or", "other", "our", "out", "over", "own", "put",
+    "said", "say", "see", "she", "so", "some", "such", "than", "that",
+    "the", "their", "them", "then", "there", "these", "they", "this",
+    "those", "time", "to", "too", "two", "up", "upon", "us", "use", "very",
+    "was", "way", "we", "were", "what", "when", "which", "who", "why",
+    "will", "with", "would", "yes", "you", "your"
+};
+
+// Prix d'un mot (bytes octets en minuscules, pas forcement termine par
+// '\0') de length lettres ; short_rare : ajouter SEG_SHORT s'il est court
+static float seg_price(const char *word, size_t bytes, int length, int short_rare)
+{
+    int lo = 0, hi = sizeof(seg_common) / sizeof(seg_common[0]);
+    while (lo < hi){
+        int mid = (lo + hi) / 2;
+        int r = strncmp(word, seg_common[mid], bytes);
+        if (r == 0 && seg_common[mid][bytes] != '\0')
+            r = -1;
+        if (r == 0)
+            return SEG_COMMON;
+        if (r < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return 1 + (short_rare && length <= SEG_SHORT_LENGTH ? SEG_SHORT : 0);
+}
+
+struct segment_stats {
+    unsigned long tokens;
+    unsigned long islands;          // ilots examines : un mot inconnu ou plusieurs mots
+    unsigned long lookups;          // recherches exactes de morceaux
+    unsigned long searches;         // corrections (parcours d'un paquet)
+    unsigned long merged;           // morceaux sur plusieurs mots
+    unsigned long split;            // espaces ajoutes dans un mot
+    struct junk_stats junk;
+    double elapsed;
+};
+
+struct seg_token {
+    size_t start, end;              // octets dans le texte
+    int first, last;                // lettres [first, last) de l'ilot
+    int unknown;
+    int best;                       // correction : indice dans le paquet, -1 si aucune
+    unsigned int dist;
+};
+
+// Ecrit l'ilot de tokens [0, m) corrige. letters : les mots en minuscules
+// colles, offset[c] : octet de la lettre c dans letters, owner[c] : son mot
+static void segment_island(struct lexicon *lex, const char *text, struct seg_token *tok, int m, FILE *out, struct segment_stats *stats)
+{
+    struct arena_mark mark = arena_mark(&thread_arena);
+    int n = tok[m - 1].last;
+    size_t bytes = 0;
+    for (int t = 0; t < m; t++)
+        bytes += tok[t].end - tok[t].start;
+    char *letters = arena_alloc(&thread_arena, bytes + 1);
+    int *offset = arena_alloc(&thread_arena, (n + 1) * sizeof(int));
+    int *owner = arena_alloc(&thread_arena, (n + 1) * sizeof(int));
+    float *cost = arena_alloc(&thread_arena, (n + 1) * sizeof(float));
+    int *back = arena_alloc(&thread_arena, (n + 1) * sizeof(int));
+    char *valid = arena_alloc(&thread_arena, n + 1);
+    size_t b = 0;
+    for (int t = 0; t < m; t++){
+        size_t len = tok[t].end - tok[t].start;
+        utf8_fold(letters + b, text + tok[t].start, len);
+        size_t k = 0;
+        for (int c = tok[t].first; c < tok[t].last; c++){
+            offset[c] = b + k;
+            owner[c] = t;
+            utf8_decode(letters + b, len, &k);
+        }
+        b += len;
+        valid[tok[t].first] = 1;
+        for (int c = tok[t].first + 1; c < tok[t].last; c++)
+            valid[c] = tok[t].unknown;
+    }
+    offset[n] = b;
+    owner[n] = m;
+    valid[n] = 1;
+    for (int c = 0; c <= n; c++){
+        cost[c] = c == 0 ? 0 : 1e30f;
+        back[c] = -1;
+    }
+
+    for (int i = 0; i < n; i++){
+        if (!valid[i] || cost[i] >= 1e30f)
+            continue;
+        int t = owner[i];
+        // mot d'origine entier
+        if (i == tok[t].first){
+            int length = tok[t].last - tok[t].first;
+            float c = cost[i];
+            if (!tok[t].unknown)
+                c += seg_price(letters + offset[i], offset[tok[t].last] - offset[i], length, 1);
+            else if (tok[t].best < 0)
+                c += 1 + SEG_EDIT * 50;
+            else {
+                const char *best = lex->buckets[length].words + tok[t].best * lex->buckets[length].stride;
+                c += seg_price(best, strlen(best), length, 1) + SEG_EDIT * tok[t].dist;
+            }
+            if (c < cost[tok[t].last]){
+                cost[tok[t].last] = c;
+                back[tok[t].last] = i;
+            }
+        }
+        // morceaux du lexique
+        for (int j = i + SEG_MIN_PIECE; j <= n && j - i <= LEXICON_MAX_LENGTH; j++){
+            int last = owner[j - 1];
+            if (last - t >= SEG_WINDOW)
+                break;
+            if (!valid[j] || (i == tok[t].first && j == tok[t].last))
+                continue;
+            int touches = 0;
+            for (int u = t; u <= last; u++)
+                touches |= tok[u].unknown;
+            if (!touches && (i != tok[t].first || j != tok[last].last))
+                continue;
+            stats->lookups++;
+            if (lexicon_find(lex, letters + offset[i], offset[j] - offset[i], j - i) < 0)
+                continue;
+            int changes = (last - t) + (i != tok[t].first) + (j != tok[last].last);
+            float c = cost[i] + SEG_CHANGE * changes + seg_price(letters + offset[i], offset[j] - offset[i], j - i, 1);
+            if (!touches)
+                c += SEG_KNOWN * (last - t);
+            if (c < cost[j]){
+                cost[j] = c;
+                back[j] = i;
+            }
+        }
+    }
+
+    // morceaux retenus, de la fin vers le debut
+    int *cut = arena_alloc(&thread_arena, (n + 1) * sizeof(int));
+    int nb_cuts = 0;
+    for (int c = n; c > 0; c = back[c])
+        cut[nb_cuts++] = c;
+    cut[nb_cuts] = 0;
+    for (int k = nb_cuts; k > 0; k--){
+        int i = cut[k], j = cut[k - 1];
+        int t = owner[i], last = owner[j - 1];
+        if (k < nb_cuts){
+            if (i == tok[t].first)
+                fwrite(text + tok[t - 1].end, 1, tok[t].start - tok[t - 1].end, out);
+            else
+                fputc(' ', out);
+        }
+        if (i == tok[t].first && j == tok[t].last){
+            if (!tok[t].unknown || tok[t].best < 0){
+                fwrite(text + tok[t].start, 1, tok[t].end - tok[t].start, out);
+                continue;
+            }
+            struct bucket *bk = &lex->buckets[tok[t].last - tok[t].first];
+            char *t_word = arena_strdup(&thread_arena, bk->words + tok[t].best * bk->stride);
+            if (utf8_first_upper(text + tok[t].start, tok[t].end - tok[t].start))
+                utf8_upper_first(t_word);
+            fputs(t_word, out);
+            continue;
+        }
+        stats->merged += last > t;
+        stats->split += j != tok[last].last;
+        char *piece = arena_alloc(&thread_arena, offset[j] - offset[i] + 1);
+        memcpy(piece, letters + offset[i], offset[j] - offset[i]);
+        piece[offset[j] - offset[i]] = '\0';
+        // la casse de la premiere lettre du morceau dans le texte
+        size_t k = 0, len = tok[t].end - tok[t].start;
+        for (int c = tok[t].first; c < i; c++)
+            utf8_decode(text + tok[t].start, len, &k);
+        if (utf8_first_upper(text + tok[t].start + k, len - k))
+            utf8_upper_first(piece);
+        fputs(piece, out);
+    }
+    arena_release(&thread_arena, mark);
+}
+
+// Mot du lexique obtenu en echangeant deux lettres voisines de word (en
+// minuscules, length lettres) : son indice dans le paquet, -1 si aucun
+static int seg_swap(struct lexicon *lex, const char *word, int length)
+{
+    size_t len = strlen(word), a = 0, b = 0;
+    char *swapped = arena_alloc(&thread_arena, len + 1);
+    utf8_decode(word, len, &b);
+    while (b < len){
+        // lettres [a, b) et [b, c)
+        size_t c = b;
+        utf8_decode(word, len, &c);
+        memcpy(swapped, word, a);
+        memcpy(swapped + a, word + b, c - b);
+        memcpy(swapped + a + c - b, word + a, b - a);
+        memcpy(swapped + c, word + c, len - c);
+        if (memcmp(swapped + a, word + a, c - a) != 0){
+            int i = lexicon_find(lex, swapped, len, length);
+            if (i >= 0)
+                return i;
+        }
+        a = b;
+        b = c;
+    }
+    return -1;
+}
+
+// Ecrit dans file_dupli le texte [0, len) corrige, espaces compris
+static void segment_text(struct lexicon *lex, const char *text, size_t len, FILE *file_dupli, struct segment_stats *stats)
+{
+    size_t cap = 64;
+    struct seg_token *tok = malloc(cap * sizeof(struct seg_token));
+    size_t i = 0, written = 0;
+    while (i < len){
+        // ilot : mots separes seulement par des espaces
+        int m = 0, letters = 0, unknown = 0;
+        size_t n = utf8_word_char(text, len, i);
+        if (n == 0){
+            i++;
+            continue;
+        }
+        for (;;){
+            if ((size_t)m == cap){
+                struct seg_token *bigger = malloc(2 * cap * sizeof(struct seg_token));
+                memcpy(bigger, tok, cap * sizeof(struct seg_token));
+                free(tok);
+                tok = bigger;
+                cap *= 2;
+            }
+            struct seg_token *t = &tok[m++];
+            t->start = i;
+            t->first = letters;
+            while (n > 0){
+                i += n;
+                letters++;
+                n = i < len ? utf8_word_char(text, len, i) : 0;
+            }
+            t->end = i;
+            t->last = letters;
+            t->unknown = 0;
+            t->best = -1;
+            stats->tokens++;
+            if (t->last - t->first <= LEXICON_MAX_LENGTH){
+                struct arena_mark mark = arena_mark(&thread_arena);
+                char *word = arena_alloc(&thread_arena, t->end - t->start + 1);
+                utf8_fold(word, text + t->start, t->end - t->start);
+                if (lexicon_exist(lex, word) == 2 && junk_count(lex, word, &stats->junk) == JUNK_NONE){
+                    t->unknown = 1;
+                    t->best = lexicon_search(lex, word, 0, 0, &t->dist);
+                    stats->searches++;
+                    int swap = t->dist == 2 ? seg_swap(lex, word, t->last - t->first) : -1;
+                    if (swap >= 0){
+                        t->best = swap;
+                        t->dist = 1;
+                    }
+                    unknown++;
+                }
+                arena_release(&thread_arena, mark);
+            }
+            size_t next = i;
+            while (next < len && text[next] == ' ')
+                next++;
+            if (next == i || next >= len || (n = utf8_word_char(text, len, next)) == 0)
+                break;
+            i = next;
+        }
+        if (unknown == 0 && m < 2)
+            continue;
+        stats->islands++;
+        fwrite(text + written, 1, tok[0].start - written, file_dupli);
+        segment_island(lex, text, tok, m, file_dupli, stats);
+        written = tok[m - 1].end;
+    }
+    fwrite(text + written, 1, len - written, file_dupli);
+    free(tok);
+}
+
+// Comme first_file, mais en corrigeant aussi les espaces perdus ou en trop.
+// stats (si non NULL) recoit les comptes.
+void first_file_segment(char* filename, struct segment_stats *stats)
+{
+    struct segment_stats local_stats;
+    if (stats == NULL)
+        stats = &local_stats;
+    memset(stats, 0, sizeof(struct segment_stats));
+    double t0 = now_seconds();
+    struct lexicon *lex = default_lexicon();
+    FILE* file = fopen(filename,"r");
+    if (lex == NULL || file == NULL){
+        if (file != NULL)
+            fclose(file);
+        return;
+    }
+    struct arena arena = {NULL, NULL};
+    fseek(file, 0, SEEK_END);
+    size_t len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *text = arena_alloc(&arena, len + 1);
+    len = fread(text, 1, len, file);
+    text[len] = '\0';
+    fclose(file);
+
+    char* start = "c_";
+    char *filename_dupli = arena_alloc(&arena, strlen(start) + strlen(filename) + 1);
+    strcpy(filename_dupli, start);
+    strcat(filename_dupli, filename);
+    FILE* file_dupli = fopen(filename_dupli,"w");
+    if (file_dupli != NULL){
+        segment_text(lex, text, len, file_dupli, stats);
+        fclose(file_dupli);
+    }
+    arena_free(&arena);
+    stats->elapsed = now_seconds() - t0;
+}
+
+void print_segment_stats(struct segment_stats *stats)
+{
+    printf("segmentation : %lu mots, %lu ilots examines, %lu recherches exactes, %lu corrections, "
+           "%lu fusions, %lu coupures, %.3f s\n", stats->tokens, stats->islands, stats->lookups,
+           stats->searches, stats->merged, stats->split, stats->elapsed);
+    print_junk_stats(&stats->junk);
+}
+
+/////////////////////////// PARTIE BUDGET ///////////////////////////////////
+/*
+    Recherche avec budget (temps et/ou nombre de distances calculees) pour
+    le chemin en ligne : un mot pathologique ne doit pas bloquer la reponse.
+    Les candidats d'un paquet sont vus du plus prometteur au moins
+    prometteur, par des bornes inferieures de la distance tirees des
+    symboles (lettres a..z, autre) :
+    - le masque des symboles de chaque mot est calcule au chargement
+      (bucket.masks) ; un symbole present d'un seul cote coute au moins une
+      operation. Tout le paquet est borne ainsi en une boucle sans
+      branchement, sous l'echeance (compte dans budget_stats), puis visite
+      par borne croissante ;
+    - pour un candidat visite, la borne des histogrammes : si le mot OCR a
+      P symboles en trop et N en moins, il faut au moins max(P, N)
+      operations.
+    La recherche s'arrete d'elle-meme quand la borne depasse la meilleure
+    distance, sinon quand le budget est epuise : on rend alors le
+    meilleur trouve avec truncated = 1. Sans troncature,
+    le resultat est celui de lexicon_correction (egalites departagees par
+    l'ordre du fichier).
+*/
+#define BUDGET_CHECK 64             // distances entre deux lectures de l'horloge
+#define BUDGET_CHUNK 4096           // candidats bornes entre deux lectures de l'horloge
+
+struct search_budget {
+    double seconds;                 // par requete, 0 : pas de limite
+    long work;                      // distances par requete, 0 : pas de limite
+};
+
+struct budget_stats {
+    unsigned long requests;
+    unsigned long truncated;        // requetes arretees par le budget
+    unsigned long work;             // distances calculees
+    unsigned long ordered;          // candidats bornes par leur masque
+    unsigned long pruned;           // candidats ecartes par la borne
+    double worst;                   // plus longue requete, secondes
+};
+
+struct budget_run {
+    double start;
+    double deadline;
+    long work_left;                 // < 0 : pas de limite
+    unsigned long work;
+    unsigned long ordered;
+    unsigned long pruned;
+    int truncated;
+};
+
+static void budget_start(struct budget_run *run, const struct search_budget *budget)
+{
+    memset(run, 0, sizeof(struct budget_run));
+    run->start = now_seconds();
+    run->deadline = budget != NULL && budget->seconds > 0 ? run->start + budget->seconds : 0;
+    run->work_left = budget != NULL && budget->work > 0 ? budget->work : -1;
+}
+
+// 1 si une distance de plus est permise
+static int budget_spend(struct budget_run *run)
+{
+    if (run->truncated)
+        return 0;
+    if (run->work_left == 0 || (run->deadline > 0 && run->work % BUDGET_CHECK == 0 && now_seconds() > run->deadline)){
+        run->truncated = 1;
+        return 0;
+    }
+    if (run->work_left > 0)
+        run->work_left--;
+    run->work++;
+    return 1;
+}
+
+// 1 si une tranche de plus peut etre bornee
+static int budget_order_spend(struct budget_run *run)
+{
+    if (run->truncated)
+        return 0;
+    if (run->deadline > 0 && now_seconds() > run->deadline){
+        run->truncated = 1;
+        return 0;
+    }
+    return 1;
+}
+
+static void budget_end(struct budget_run *run, struct budget_stats *stats)
+{
+    if (stats == NULL)
+        return;
+    double elapsed = now_seconds() - run->start;
+    stats->requests++;
+    stats->truncated += run->truncated;
+    stats->work += run->work;
+    stats->ordered += run->ordered;
+    stats->pruned += run->pruned;
+    if (elapsed > stats->worst)
+        stats->worst = elapsed;
+}
+
+static void symbol_histogram(const char *word, unsigned char *histogram)
+{
+    size_t len = strlen(word), k = 0;
+    memset(histogram, 0, TRIGRAM_SYMBOLS);
+    while (k < len)
+        histogram[trigram_symbol(utf8_decode(word, len, &k))]++;
+}
+
+// Borne des histogrammes : max(symboles en trop, symboles en moins)
+static unsigned int histogram_bound(const unsigned char *query, const char *word)
+{
+    unsigned char candidate[TRIGRAM_SYMBOLS];
+    symbol_histogram(word, candidate);
+    int more = 0, less = 0;
+    for (int s = 1; s < TRIGRAM_SYMBOLS; s++){
+        int d = query[s] - candidate[s];
+        if (d > 0)
+            more += d;
+        else
+            less -= d;
+    }
+    return more > less ? more : less;
+}
+
+// Borne des masques des mots [start, end) dans bound (start multiple de
+// MASK_BLOCK, bound rempli jusqu'a MASK_ROUND(end)) : chaque symbole
+// present d'un seul cote coute au moins une operation, soit
+// max(|q|, |c|) - |q & c|. Blocs de taille fixe sans branchement : le
+// compilateur les vectorise.
+static void mask_bounds(const uint32_t *restrict masks, uint32_t query, int start, int end, unsigned char *restrict bound)
+{
+    unsigned int pq = query >> 27;
+    for (int i = start; i < end; i += MASK_BLOCK){
+        for (int j = 0; j < MASK_BLOCK; j++){
+            uint32_t c = masks[i + j];
+            uint32_t x = query & c & MASK_SYMBOLS;
+            x -= (x >> 1) & 0x55555555u;
+            x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+            x = (x + (x >> 4)) & 0x0F0F0F0Fu;
+            x += x >> 8;
+            x += x >> 16;
+            unsigned int pc = c >> 27;
+            bound[i + j] = (pc > pq ? pc : pq) - (x & 0x3F);
+        }
+    }
+}
+
+// Recherche anytime dans le paquet b ; ties recoit les indices a distance
+// minimale, les nb + 1 plus petits (tous si nb < 0), tries. Renvoie la
+// distance minimale trouvee (50 si aucune).
+static unsigned int budget_search_bucket(struct bucket *b, const char *word, int plus, int nb, unsigned int *ties, int *nb_ties, struct budget_run *run)
+{
+    struct tie_set set;
+    tie_set_init(&set, nb >= 0 ? nb + 1 : b->count, ties, NULL);
+    *nb_ties = 0;
+    if (b->count == 0)
+        return set.min_dist;
+    struct arena_mark mark = arena_mark(&thread_arena);
+    unsigned char *bound = arena_alloc(&thread_arena, MASK_ROUND(b->count));
+    unsigned char query[TRIGRAM_SYMBOLS];
+    symbol_histogram(word, query);
+    uint32_t query_mask = symbol_mask(word);
+    // tout le paquet est borne d'abord (masques), sous l'echeance
+    int bounded = 0;
+    while (bounded < b->count && budget_order_spend(run)){
+        int end = bounded + BUDGET_CHUNK < b->count ? bounded + BUDGET_CHUNK : b->count;
+        mask_bounds(b->masks, query_mask, bounded, end, bound);
+        run->ordered += end - bounded;
+        bounded = end;
+    }
+    struct packed_query pq;
+    pack_query(b, word, plus, &pq);
+    // puis les candidats par borne croissante ; la borne des histogrammes,
+    // plus fine, n'est calculee que pour eux
+    int seen = 0;
+    for (unsigned int d = 0; d <= set.min_dist && d <= 32 && !run->truncated; d++){
+        const unsigned char *p = bound;
+        while ((p = memchr(p, d, bound + bounded - p)) != NULL){
+            int i = p++ - bound;
+            seen++;
+            if (b->dead > 0 && b->words[i * b->stride] == '\0')
+                continue;
+            unsigned int lower = histogram_bound(query, b->words + i * b->stride);
+            if (lower > set.min_dist || (lower == set.min_dist && !tie_set_open(&set, i))){
+                run->pruned++;
+                continue;
+            }
+            if (!budget_spend(run))
+                break;
+            unsigned int h = 0;
+            if (pq.ok){
+                uint64_t w[2] = {0, 0};
+                memcpy(w, b->packed + (size_t)i * b->packed_words, b->packed_words * sizeof(uint64_t));
+                h = nonzero_bytes(w[0] ^ pq.word[0]) + nonzero_bytes(w[1] ^ pq.word[1]);
+            }
+            unsigned int distance = candidate_distance(b->words + i * b->stride, word, &pq, h, set.min_dist, tie_set_open(&set, i));
+            tie_set_add(&set, distance, i, i);
+        }
+    }
+    if (!run->truncated)
+        run->pruned += bounded - seen;
+    arena_release(&thread_arena, mark);
+    *nb_ties = set.count;
+    return set.min_dist;
+}
+
+// Comme lexicon_correction dans la limite du budget ; *truncated (si non
+// NULL) vaut 1 si le resultat n'est que le meilleur trouve a temps
+char* lexicon_correction_budget(struct lexicon *lex, char* ocr_word, int nb, int plus, const struct search_budget *budget,
+                                int *truncated, struct budget_stats *stats) // thread_arena
+{
+    struct budget_run run;
+    budget_start(&run, budget);
+    int l_word = utf8_length(ocr_word);
+    char *result = NULL;
+    if (l_word >= 3 && l_word + plus >= 1 && l_word + plus <= LEXICON_MAX_LENGTH && nb >= 0){
+        struct bucket *b = &lex->buckets[l_word + plus];
+        unsigned int *ties = arena_alloc(&thread_arena, (nb + 1) * sizeof(unsigned int));
+        int nb_ties;
+        budget_search_bucket(b, ocr_word, plus, nb, ties, &nb_ties, &run);
+        if (nb_ties > 0)
+            result = arena_strdup(&thread_arena, b->words + ties[nb_ties - 1] * b->stride);
+    }
+    if (result == NULL)
+        result = arena_strdup(&thread_arena, ocr_word);
+    if (truncated != NULL)
+        *truncated = run.truncated;
+    budget_end(&run, stats);
+    return result;
+}
+
+// Comme correction_solutions sur le lexique par defaut, une requete avec
+// un seul budget : un parcours par paquet (au lieu de nb_solutions + 1),
+// les paquets les plus proches de la longueur du mot d'abord.
+void correction_solutions_budget(char* word, int var_avant, int var_apres, const struct search_budget *budget, struct budget_stats *stats)
+{
+    struct lexicon *lex = default_lexicon();
+    if (lex == NULL)
+        return;
+    int r_exist = lexicon_exist(lex, word);
+    if (r_exist == 0)
+        printf("\"%s\" not long enough for correction !\n", word);
+    if (r_exist == 1)
+        printf("\"%s\" is correct.\n", word);
+    if (r_exist != 2)
+        return;
+    struct arena_mark mark = arena_mark(&thread_arena);
+    struct budget_run run;
+    budget_start(&run, budget);
+    int l_word = utf8_length(word);
+    int nb_plus = var_apres - var_avant + 1;
+    unsigned int **ties = arena_alloc(&thread_arena, (nb_plus + 1) * sizeof(unsigned int *));
+    int *nb_ties = arena_alloc(&thread_arena, (nb_plus + 1) * sizeof(int));
+    memset(nb_ties, 0, (nb_plus + 1) * sizeof(int));
+    int far = abs(var_avant) > abs(var_apres) ? abs(var_avant) : abs(var_apres);
+    for (int d = 0; d <= far; d++){
+        for (int sign = 1; sign >= -1; sign -= 2){
+            int plus = sign * d;
+            if (plus < var_avant || plus > var_apres || (d == 0 && sign < 0))
+                continue;
+            if (l_word + plus < 1 || l_word + plus > LEXICON_MAX_LENGTH)
+                continue;
+            struct bucket *b = &lex->buckets[l_word + plus];
+            ties[plus - var_avant] = arena_alloc(&thread_arena, (b->count + 1) * sizeof(unsigned int));
+            budget_search_bucket(b, word, plus, -1, ties[plus - var_avant], &nb_ties[plus - var_avant], &run);
+        }
+    }
+    printf("Possible solutions :\n");
+    for (int plus = var_avant; plus <= var_apres; plus++){
+        if (nb_ties[plus - var_avant] == 0)
+            continue;
+        struct bucket *b = &lex->buckets[l_word + plus];
+        for (int k = 0; k < nb_ties[plus - var_avant]; k++)
+            printf("%s\n", b->words + ties[plus - var_avant][k] * b->stride);
+    }
+    if (run.truncated)
+        printf("(budget epuise : meilleures solutions trouvees a temps)\n");
+    budget_end(&run, stats);
+    arena_release(&thread_arena, mark);
+}
+
+void print_budget_stats(struct budget_stats *stats)
+{
+    printf("budget : %lu requetes, %lu tronquees (%.1f%%), %lu distances, %lu candidats bornes, %lu ecartes, pire %.3f ms\n",
+           stats->requests, stats->truncated, stats->requests ? 100.0 * stats->truncated / stats->requests : 0,
+           stats->work, stats->ordered, stats->pruned, 1e3 * stats->worst);
+}
+
+/////////////////////////// PARTIE HOCR / ALTO //////////////////////////////
+/*
+    Entree XML d'OCR avec une confiance par mot :
+    - hOCR : <span class='ocrx_word' title='bbox 36 92 96 116; x_wconf 95'>This</span>
+    - ALTO : <String HPOS="36" VPOS="92" ... CONTENT="This" WC="0.95"/>
+    Le fichier est projete en memoire et parcouru une seule fois : tout ce
+    qui n'est pas le texte d'un mot peu sur (balises, geometrie, mots
+    surs) est recopie tel quel depuis la projection, sans copie
+    intermediaire. Seuls les mots sous le seuil de confiance (0..100, WC
+    d'ALTO est ramene sur 100) passent par le filtre et la recherche ; un
+    mot sans confiance est traite comme peu sur.
+*/
+struct ocr_xml_stats {
+    unsigned long words;            // mots hOCR / ALTO
+    unsigned long confident;        // au dessus du seuil, recopies
+    unsigned long searched;         // recherches dans le lexique
+    unsigned long changed;          // mots reecrits
+    struct junk_stats junk;
+    double elapsed;
+};
+
+// Valeur de l'attribut name dans la balise [tag, end), NULL s'il n'y est pas
+static const char *xml_attribute(const char *tag, const char *end, const char *name, size_t *length)
+{
+    size_t n = strlen(name);
+    for (const char *p = tag + 1; p + n < end; p++){
+        if ((p[-1] != ' ' && p[-1] != '\t' && p[-1] != '\n' && p[-1] != '\r') || memcmp(p, name, n) != 0)
+            continue;
+        const char *q = p + n;
+        while (q < end && *q == ' ')
+            q++;
+        if (q >= end || *q != '=')
+            continue;
+        q++;
+        while (q < end && *q == ' ')
+            q++;
+        if (q >= end || (*q != '"' && *q != '\''))
+            continue;
+        const char *close = memchr(q + 1, *q, end - q - 1);
+        if (close == NULL)
+            return NULL;
+        *length = close - q - 1;
+        return q + 1;
+    }
+    return NULL;
+}
+
+// Position de la premiere occurrence de pattern dans [p, end), ou end
+static const char *xml_find(const char *p, const char *end, const char *pattern)
+{
+    size_t n = strlen(pattern);
+    while (p + n <= end){
+        p = memchr(p, pattern[0], end - p - n + 1);
+        if (p == NULL)
+            return end;
+        if (memcmp(p, pattern, n) == 0)
+            return p;
+        p++;
+    }
+    return end;
+}
+
+// Confiance sur 100 ; -1 si la balise n'en donne pas
+static double xml_confidence(const char *tag, const char *end, int alto)
+{
+    size_t n;
+    const char *value;
+    if (alto){
+        value = xml_attribute(tag, end, "WC", &n);
+        return value != NULL ? 100 * strtod(value, NULL) : -1;
+    }
+    value = xml_attribute(tag, end, "title", &n);
+    if (value == NULL)
+        return -1;
+    const char *conf = xml_find(value, value + n, "x_wconf");
+    return conf < value + n ? strtod(conf + 7, NULL) : -1;
+}
+
+// Correction du texte d'un mot peu sur : les balises internes et les
+// entites (&apos;) sont recopiees, les mots corriges comme dans block_correct
+static void xml_correct_text(struct lexicon *lex, const char *text, size_t len, FILE *out, struct ocr_xml_stats *stats)
+{
+    size_t i = 0;
+    while (i < len){
+        size_t n = utf8_word_char(text, len, i);
+        if (n == 0){
+            size_t skip = 1;
+            const char *stop = text[i] == '<' ? memchr(text + i, '>', len - i) : text[i] == '&' ? memchr(text + i, ';', len - i) : NULL;
+            if (stop != NULL)
+                skip = stop - (text + i) + 1;
+            fwrite(text + i, 1, skip, out);
+            i += skip;
+            continue;
+        }
+        size_t w = i;
+        while (n > 0){
+            i += n;
+            n = i < len ? utf8_word_char(text, len, i) : 0;
+        }
+        if (i - w > 4 * LEXICON_MAX_LENGTH){
+            fwrite(text + w, 1, i - w, out);
+            continue;
+        }
+        struct arena_mark mark = arena_mark(&thread_arena);
+        char *word = arena_alloc(&thread_arena, i - w + 1);
+        utf8_fold(word, text + w, i - w);
+        if (lexicon_exist(lex, word) != 2 || junk_count(lex, word, &stats->junk) != JUNK_NONE){
+            fwrite(text + w, 1, i - w, out);
+        }
+        else{
+            char *t_word = lexicon_correction(lex, word, 0, 0);
+            stats->searched++;
+            if (utf8_first_upper(text + w, i - w))
+                utf8_upper_first(t_word);
+            if (strlen(t_word) != i - w || memcmp(t_word, text + w, i - w) != 0)
+                stats->changed++;
+            fputs(t_word, out);
+        }
+        arena_release(&thread_arena, mark);
+    }
+}
+
+// Corrige filename (hOCR ou ALTO) dans c_<filename>, en ne cherchant que les
+// mots de confiance < min_confidence. stats peut etre NULL. Renvoie -1 si
+// le fichier ou le lexique manque.
+int first_file_ocr_xml(char* filename, double min_confidence, struct ocr_xml_stats *stats)
+{
+    struct ocr_xml_stats local_stats;
+    if (stats == NULL)
+        stats = &local_stats;
+    memset(stats, 0, sizeof(struct ocr_xml_stats));
+    double t0 = now_seconds();
+    struct lexicon *lex = default_lexicon();
+    int fd = open(filename, O_RDONLY);
+    struct stat st;
+    if (lex == NULL || fd < 0 || fstat(fd, &st) < 0){
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    size_t len = st.st_size;
+    const char *text = len > 0 ? mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0) : "";
+    close(fd);
+    if (text == MAP_FAILED)
+        return -1;
+    madvise((void *)text, len, MADV_SEQUENTIAL);
+
+    char* start = "c_";
+    char* filename_dupli = malloc(strlen(start) + strlen(filename) + 1);
+    strcpy(filename_dupli, start);
+    strcat(filename_dupli, filename);
+    FILE* file_dupli = fopen(filename_dupli,"w");
+    free(filename_dupli);
+    if (file_dupli == NULL){
+        if (len > 0)
+            munmap((void *)text, len);
+        return -1;
+    }
+
+    const char *end = text + len;
+    const char *written = text;
+    const char *p = text;
+    while ((p = memchr(p, '<', end - p)) != NULL){
+        if (end - p >= 4 && memcmp(p, "<!--", 4) == 0){
+            p = xml_find(p, end, "-->");
+            continue;
+        }
+        const char *tag_end = memchr(p, '>', end - p);
+        if (tag_end == NULL)
+            break;
+        const char *name = p + 1, *name_end = name;
+        while (name_end < tag_end && *name_end != ' ' && *name_end != '\t' && *name_end != '\n' && *name_end != '/')
+            name_end++;
+        size_t class_len;
+        const char *class = NULL;
+        int alto = name_end - name == 6 && memcmp(name, "String", 6) == 0;
+        if (!alto && (class = xml_attribute(p, tag_end, "class", &class_len)) != NULL)
+            class = xml_find(class, class + class_len, "ocrx_word") < class + class_len ? class : NULL;
+        if (!alto && class == NULL){
+            p = tag_end + 1;
+            continue;
+        }
+
+        // texte du mot : attribut CONTENT (ALTO) ou contenu jusqu'a la balise fermante (hOCR)
+        const char *word, *word_end;
+        size_t n;
+        if (alto){
+            word = xml_attribute(p, tag_end, "CONTENT", &n);
+            word_end = word != NULL ? word + n : NULL;
+        }
+        else{
+            char close[64];
+            snprintf(close, sizeof(close), "</%.*s", (int)(name_end - name < 32 ? name_end - name : 32), name);
+            word = tag_end + 1;
+            word_end = xml_find(word, end, close);
+            if (word_end == end)
+                word = NULL;
+        }
+        if (word == NULL){
+            p = tag_end + 1;
+            continue;
+        }
+        stats->words++;
+        double confidence = xml_confidence(p, tag_end, alto);
+        if (confidence >= min_confidence)
+            stats->confident++;
+        else{
+            fwrite(written, 1, word - written, file_dupli);
+            xml_correct_text(lex, word, word_end - word, file_dupli, stats);
+            written = word_end;
+        }
+        p = alto ? tag_end + 1 : word_end;
+    }
+    fwrite(written, 1, end - written, file_dupli);
+    fclose(file_dupli);
+    if (len > 0)
+        munmap((void *)text, len);
+    stats->elapsed = now_seconds() - t0;
+    return 0;
+}
+
+void print_ocr_xml_stats(struct ocr_xml_stats *stats)
+{
+    printf("ocr xml : %lu mots, %lu surs recopies (%.1f%%), %lu recherches, %lu reecrits, %.3f s\n",
+           stats->words, stats->confident, stats->words ? 100.0 * stats->confident / stats->words : 0,
+           stats->searched, stats->changed, stats->elapsed);
+    print_junk_stats(&stats->junk);
+}
+
+/////////////////////////// PARTIE ENTREES / SORTIES PAR LOT //////////////////
+/*
+    Correction d'un grand nombre de petits fichiers. Les fichiers sont
+    traites par lots de IO_BATCH ; chaque lot passe par io_uring en trois
+    appels systeme : ouverture des entrees, lecture de chaque fichier en
+    entier dans un tampon reutilise avec ouverture de sa sortie, puis une seule
+    ecriture par sortie suivie de sa fermeture (liee a l'ecriture) et de la
+    fermeture des entrees. La correction du lot est faite entre la lecture
+    et l'ecriture par un groupe de threads, comme dans le pipeline.
+    Si io_uring n'est pas disponible (noyau ancien, seccomp) ou ne connait
+    pas OPENAT / READ / WRITE / CLOSE (noyaux 5.1 a 5.5, verifie par
+    IORING_REGISTER_PROBE), chaque thread du groupe traite ses fichiers de
+    bout en bout avec open / read / write. La sortie de rep/f.txt est
+    rep/c_f.txt.
+*/
+
+#define IO_BATCH 64                 // fichiers par lot
+#define IO_BUFFER 16384             // taille initiale du tampon d'un fichier
+#define IO_MAX_THREADS 16
+
+struct io_stats {
+    int uring;                      // 1 : io_uring, 0 : repli sur les threads
+    int nb_threads;
+    unsigned long files;
+    unsigned long failed;           // entree ou sortie impossible a ouvrir
+    unsigned long bytes_in;
+    unsigned long bytes_out;
+    unsigned long syscalls;         // appels systeme d'entree / sortie
+    unsigned long batches;
+    double io;                      // secondes d'E/S (io_uring seulement)
+    double elapsed;
+    struct junk_stats junk;
+};
+
+struct io_slot {
+    const char *filename;
+    char *output_name;              // rep/c_<nom> pour rep/<nom>
+    int in_fd;
+    int out_fd;
+    int error;
+    size_t cap;                     // taille de block.text
+    unsigned long syscalls;         // appels faits par le thread du slot
+    struct block block;
+};
+
+struct uring {
+    int fd;
+    unsigned entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size;
+    unsigned queued;                // entrees pas encore soumises
+};
+
+static int uring_init(struct uring *r, unsigned entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(r, 0, sizeof(struct uring));
+    r->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0)
+        return -1;
+    r->entries = p.sq_entries;
+    r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP){
+        if (r->cq_ring_size > r->sq_ring_size)
+            r->sq_ring_size = r->cq_ring_size;
+        r->cq_ring_size = r->sq_ring_size;
+    }
+    r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ring == MAP_FAILED){
+        close(r->fd);
+        return -1;
+    }
+    r->cq_ring = r->sq_ring;
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP))
+        r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+    r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->cq_ring == MAP_FAILED || r->sqes == MAP_FAILED){
+        if (r->cq_ring != MAP_FAILED && r->cq_ring != r->sq_ring)
+            munmap(r->cq_ring, r->cq_ring_size);
+        if (r->sqes != MAP_FAILED)
+            munmap(r->sqes, p.sq_entries * sizeof(struct io_uring_sqe));
+        munmap(r->sq_ring, r->sq_ring_size);
+        close(r->fd);
+        return -1;
+    }
+    char *sq = r->sq_ring, *cq = r->cq_ring;
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+// 1 si le noyau connait les operations ops ; IORING_REGISTER_PROBE
+// n'existe pas avant 5.6, comme OPENAT, READ, WRITE et CLOSE
+static int uring_probe(struct uring *r, const int *ops, int nb_ops)
+{
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    int ok = syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (int k = 0; ok && k < nb_ops; k++)
+        ok = ops[k] <= probe->last_op && (probe->ops[ops[k]].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return ok;
+}
+
+static void uring_free(struct uring *r)
+{
+    munmap(r->sqes, r->entries * sizeof(struct io_uring_sqe));
+    if (r->cq_ring != r->sq_ring)
+        munmap(r->cq_ring, r->cq_ring_size);
+    munmap(r->sq_ring, r->sq_ring_size);
+    close(r->fd);
+}
+
+// Ajoute une operation a la file de soumission (sans appel systeme).
+// Le lot ne depasse jamais r->entries operations. link : l'operation
+// suivante attend celle-ci, meme si elle echoue (fermeture apres ecriture).
+static void uring_prep(struct uring *r, int opcode, int fd, const void *addr, unsigned len, int flags, unsigned long long data, int link)
+{
+    unsigned tail = *r->sq_tail;
+    unsigned index = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long long)(uintptr_t)addr;
+    sqe->len = len;
+    sqe->open_flags = flags;
+    sqe->user_data = data;
+    sqe->flags = link ? IOSQE_IO_HARDLINK : 0;
+    r->sq_array[index] = index;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->queued++;
+}
+
+// Soumet les operations en attente et attend toutes leurs completions ;
+// res[user_data] recoit le resultat. Renvoie -1 si io_uring_enter echoue.
+static int uring_run(struct uring *r, long *res, unsigned long *syscalls)
+{
+    unsigned waiting = r->queued;
+    unsigned submit = r->queued;
+    while (waiting > 0){
+        int ret = syscall(__NR_io_uring_enter, r->fd, submit, waiting, IORING_ENTER_GETEVENTS, NULL, 0);
+        (*syscalls)++;
+        if (ret < 0)
+            return -1;
+        submit = (unsigned)ret < submit ? submit - ret : 0;
+        unsigned head = *r->cq_head;
+        unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail){
+            struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+            res[cqe->user_data] = cqe->res;
+            head++;
+            waiting--;
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+    r->queued = 0;
+    return 0;
+}
+
+// Lit la fin d'un fichier plus grand que son tampon ; le tampon grandit
+// et reste au slot pour les lots suivants
+static void io_read_rest(struct io_slot *s, unsigned long *syscalls)
+{
+    for (;;){
+        if (s->block.len + 1 >= s->cap){
+            char *bigger = malloc(2 * s->cap);
+            if (bigger == NULL){
+                s->error = 1;
+                break;
+            }
+            memcpy(bigger, s->block.text, s->block.len);
+            free(s->block.text);
+            s->block.text = bigger;
+            s->cap *= 2;
+        }
+        ssize_t n = pread(s->in_fd, s->block.text + s->block.len, s->cap - 1 - s->block.len, s->block.len);
+        (*syscalls)++;
+        if (n <= 0)
+            break;
+        s->block.len += n;
+    }
+}
+
+static void io_write_rest(struct io_slot *s, size_t done, unsigned long *syscalls)
+{
+    while (done < s->block.out_len){
+        ssize_t n = pwrite(s->out_fd, s->block.out + done, s->block.out_len - done, done);
+        (*syscalls)++;
+        if (n <= 0){
+            s->error = 1;
+            break;
+        }
+        done += n;
+    }
+}
+
+// Groupe de threads cree une fois pour tout first_files_io : chaque lot
+// est publie sous lock (batch++), les threads se le partagent par next
+// et le dernier a finir reveille l'appelant
+struct io_group {
+    struct lexicon *lex;
+    struct io_slot *slots;
+    int nb_slots;
+    int sync;                       // 1 : E/S faites par les threads eux-memes
+    _Atomic int next;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned long batch;            // numero du dernier lot publie
+    int busy;                       // threads pas encore sortis du lot
+    int stop;
+    int nb_threads;                 // threads crees (sans l'appelant)
+    pthread_t threads[IO_MAX_THREADS];
+};
+
+// Repli sans io_uring : le fichier est lu en entier, corrige, puis ecrit
+// en une fois
+static void io_slot_sync(struct lexicon *lex, struct io_slot *s)
+{
+    s->in_fd = open(s->filename, O_RDONLY);
+    s->syscalls++;
+    if (s->in_fd < 0){
+        s->error = 1;
+        return;
+    }
+    s->block.len = 0;
+    io_read_rest(s, &s->syscalls);
+    close(s->in_fd);
+    s->syscalls++;
+    block_correct(lex, &s->block);
+    s->out_fd = open(s->output_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    s->syscalls++;
+    if (s->out_fd < 0){
+        s->error = 1;
+        return;
+    }
+    io_write_rest(s, 0, &s->syscalls);
+    close(s->out_fd);
+    s->syscalls++;
+}
+
+static void io_group_work(struct io_group *g)
+{
+    int i;
+    while ((i = atomic_fetch_add(&g->next, 1)) < g->nb_slots){
+        struct io_slot *s = &g->slots[i];
+        if (g->sync)
+            io_slot_sync(g->lex, s);
+        else if (!s->error)
+            block_correct(g->lex, &s->block);
+    }
+}
+
+static void *io_group_worker(void *arg)
+{
+    struct io_group *g = arg;
+    unsigned long seen = 0;
+    pthread_mutex_lock(&g->lock);
+    for (;;){
+        while (g->batch == seen && !g->stop)
+            pthread_cond_wait(&g->start, &g->lock);
+        if (g->stop)
+            break;
+        seen = g->batch;
+        pthread_mutex_unlock(&g->lock);
+        io_group_work(g);
+        pthread_mutex_lock(&g->lock);
+        if (--g->busy == 0)
+            pthread_cond_signal(&g->done);
+    }
+    pthread_mutex_unlock(&g->lock);
+    arena_free(&thread_arena);
+    return NULL;
+}
+
+// Cree les nb_threads - 1 threads du groupe (l'appelant est le dernier)
+static void io_group_start(struct io_group *g, int nb_threads)
+{
+    pthread_mutex_init(&g->lock, NULL);
+    pthread_cond_init(&g->start, NULL);
+    pthread_cond_init(&g->done, NULL);
+    g->batch = 0;
+    g->busy = 0;
+    g->stop = 0;
+    g->nb_threads = 0;
+    for (int t = 1; t < nb_threads; t++)
+        if (pthread_create(&g->threads[g->nb_threads], NULL, io_group_worker, g) == 0)
+            g->nb_threads++;
+}
+
+static void io_group_stop(struct io_group *g)
+{
+    pthread_mutex_lock(&g->lock);
+    g->stop = 1;
+    pthread_cond_broadcast(&g->start);
+    pthread_mutex_unlock(&g->lock);
+    for (int t = 0; t < g->nb_threads; t++)
+        pthread_join(g->threads[t], NULL);
+    pthread_cond_destroy(&g->done);
+    pthread_cond_destroy(&g->start);
+    pthread_mutex_destroy(&g->lock);
+}
+
+// Repartit les slots du lot entre les threads du groupe et l'appelant
+static void io_group_run(struct io_group *g)
+{
+    atomic_store(&g->next, 0);
+    pthread_mutex_lock(&g->lock);
+    g->busy = g->nb_threads;
+    g->batch++;
+    pthread_cond_broadcast(&g->start);
+    pthread_mutex_unlock(&g->lock);
+    io_group_work(g);
+    pthread_mutex_lock(&g->lock);
+    while (g->busy > 0)
+        pthread_cond_wait(&g->done, &g->lock);
+    pthread_mutex_unlock(&g->lock);
+}
+
+// Lot abandonne (le repli le refait) : ferme les fd[k] >= 0 qui n'ont pas
+// ete fermes (closed == NULL ou closed[k] < 0)
+static void io_close_fds(const long *fd, int stride, const long *closed, int n, unsigned long *syscalls)
+{
+    for (int k = 0; k < n; k++){
+        if (fd[k * stride] < 0 || (closed != NULL && closed[k] >= 0))
+            continue;
+        close(fd[k * stride]);
+        (*syscalls)++;
+    }
+}
+
+// Un lot par io_uring : ouvertures, lectures, correction, ecritures.
+// Renvoie -1 si io_uring echoue : aucun descripteur du lot ne reste ouvert.
+// res[k] vaut -1 avant chaque appel, pour reconnaitre les operations
+// que le noyau n'a pas terminees.
+static int io_batch_uring(struct uring *r, struct io_group *g, long *res, struct io_stats *stats)
+{
+    int n = g->nb_slots;
+    long fds[2 * IO_BATCH];
+    double start = now_seconds();
+    for (int k = 0; k < n; k++){
+        res[k] = -1;
+        uring_prep(r, IORING_OP_OPENAT, AT_FDCWD, g->slots[k].filename, 0, O_RDONLY, k, 0);
+    }
+    int failed = uring_run(r, res, &stats->syscalls) < 0;
+    // un noyau qui ne connait pas l'operation repond -EINVAL
+    for (int k = 0; k < n; k++)
+        failed |= res[k] == -EINVAL;
+    if (failed){
+        io_close_fds(res, 1, NULL, n, &stats->syscalls);
+        return -1;
+    }
+    // la sortie n'est creee que si l'entree existe
+    for (int k = 0; k < n; k++)
+        g->slots[k].in_fd = res[k];
+    for (int k = 0; k < 2 * n; k++)
+        res[k] = -1;
+    for (int k = 0; k < n; k++){
+        struct io_slot *s = &g->slots[k];
+        s->error = s->in_fd < 0;
+        if (s->error)
+            continue;
+        uring_prep(r, IORING_OP_READ, s->in_fd, s->block.text, s->cap - 1, 0, 2 * k, 0);
+        uring_prep(r, IORING_OP_OPENAT, AT_FDCWD, s->output_name, 0644, O_WRONLY | O_CREAT | O_TRUNC, 2 * k + 1, 0);
+    }
+    if (uring_run(r, res, &stats->syscalls) < 0){
+        for (int k = 0; k < n; k++)
+            fds[k] = g->slots[k].in_fd;
+        io_close_fds(fds, 1, NULL, n, &stats->syscalls);
+        io_close_fds(res + 1, 2, NULL, n, &stats->syscalls);
+        return -1;
+    }
+    for (int k = 0; k < n; k++){
+        struct io_slot *s = &g->slots[k];
+        if (s->in_fd < 0)
+            continue;
+        s->out_fd = res[2 * k + 1];
+        if (res[2 * k] < 0 || s->out_fd < 0)
+            s->error = 1;
+        else{
+            s->block.len = res[2 * k];
+            if (s->block.len == s->cap - 1)
+                io_read_rest(s, &stats->syscalls);
+        }
+    }
+    stats->io += now_seconds() - start;
+
+    io_group_run(g);
+
+    start = now_seconds();
+    for (int k = 0; k < 3 * n; k++)
+        res[k] = -1;
+    for (int k = 0; k < n; k++){
+        struct io_slot *s = &g->slots[k];
+        if (s->in_fd >= 0)
+            uring_prep(r, IORING_OP_CLOSE, s->in_fd, NULL, 0, 0, 2 * k, 0);
+        if (s->out_fd < 0)
+            continue;
+        if (!s->error)
+            uring_prep(r, IORING_OP_WRITE, s->out_fd, s->block.out, s->block.out_len, 0, 2 * k + 1, 1);
+        uring_prep(r, IORING_OP_CLOSE, s->out_fd, NULL, 0, 0, 2 * n + k, 0);
+    }
+    if (uring_run(r, res, &stats->syscalls) < 0){
+        long closed[IO_BATCH];
+        for (int k = 0; k < n; k++){
+            fds[k] = g->slots[k].in_fd;
+            fds[n + k] = g->slots[k].out_fd;
+            closed[k] = res[2 * k];
+        }
+        io_close_fds(fds, 1, closed, n, &stats->syscalls);
+        io_close_fds(fds + n, 1, res + 2 * n, n, &stats->syscalls);
+        return -1;
+    }
+    for (int k = 0; k < n; k++){
+        struct io_slot *s = &g->slots[k];
+        if (s->out_fd < 0 || s->error)
+            continue;
+        if (res[2 * k + 1] < 0)
+            s->error = 1;
+        else if ((size_t)res[2 * k + 1] < s->block.out_len){
+            // ecriture partielle : la sortie est deja fermee, on la rouvre
+            s->out_fd = open(s->output_name, O_WRONLY);
+            stats->syscalls++;
+            if (s->out_fd < 0)
+                s->error = 1;
+            else{
+                io_write_rest(s, res[2 * k + 1], &stats->syscalls);
+                close(s->out_fd);
+                stats->syscalls++;
+            }
+        }
+    }
+    stats->io += now_seconds() - start;
+    return 0;
+}
+
+// Nom de sortie de filename : c_ devant le nom, dans le meme repertoire
+static char *io_output_name(const char *filename)
+{
+    const char *slash = strrchr(filename, '/');
+    size_t dir = slash != NULL ? (size_t)(slash + 1 - filename) : 0;
+    char *name = malloc(strlen(filename) + 3);
+    memcpy(name, filename, dir);
+    strcpy(name + dir, "c_");
+    strcpy(name + dir + 2, filename + dir);
+    return name;
+}
+
+// Corrige chaque rep/nom de filenames dans rep/c_nom, par lots. nb_threads
+// threads corrigent (1..IO_MAX_THREADS). stats peut etre NULL. Renvoie le
+// nombre de fichiers en echec, -1 si le lexique manque.
+long first_files_io(char **filenames, int nb_files, int nb_threads, struct io_stats *stats)
+{
+    struct io_stats local_stats;
+    if (stats == NULL)
+        stats = &local_stats;
+    memset(stats, 0, sizeof(struct io_stats));
+    double t0 = now_seconds();
+    struct lexicon *lex = default_lexicon();
+    if (lex == NULL)
+        return -1;
+    if (nb_threads < 1)
+        nb_threads = 1;
+    if (nb_threads > IO_MAX_THREADS)
+        nb_threads = IO_MAX_THREADS;
+    stats->nb_threads = nb_threads;
+
+    // 3 operations par fichier au plus dans un appel : ecriture + 2 fermetures
+    static const int ops[] = {IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE};
+    struct uring r;
+    stats->uring = uring_init(&r, 4 * IO_BATCH) == 0;
+    if (stats->uring && (r.entries < 3 * IO_BATCH || !uring_probe(&r, ops, 4))){
+        uring_free(&r);
+        stats->uring = 0;
+    }
+    long res[3 * IO_BATCH];
+
+    struct io_slot slots[IO_BATCH];
+    memset(slots, 0, sizeof(slots));
+    for (int k = 0; k < IO_BATCH; k++){
+        slots[k].cap = IO_BUFFER;
+        slots[k].block.text = malloc(IO_BUFFER);
+    }
+    struct io_group g;
+    g.lex = lex;
+    g.slots = slots;
+    io_group_start(&g, nb_threads);
+
+    for (int first = 0; first < nb_files; first += IO_BATCH){
+        int n = nb_files - first < IO_BATCH ? nb_files - first : IO_BATCH;
+        for (int k = 0; k < n; k++){
+            struct io_slot *s = &slots[k];
+            s->filename = filenames[first + k];
+            s->output_name = io_output_name(s->filename);
+            s->in_fd = s->out_fd = -1;
+            s->error = 0;
+            s->syscalls = 0;
+            s->block.len = 0;
+            s->block.out_len = 0;
+            memset(&s->block.junk, 0, sizeof(struct junk_stats));
+        }
+        g.nb_slots = n;
+        g.sync = !stats->uring;
+        if (stats->uring && io_batch_uring(&r, &g, res, stats) < 0){
+            // io_uring refuse en cours de route : le lot est refait sans lui
+            uring_free(&r);
+            stats->uring = 0;
+            first -= IO_BATCH;
+            for (int k = 0; k < n; k++)
+                free(slots[k].output_name);
+            continue;
+        }
+        if (g.sync)
+            io_group_run(&g);
+        for (int k = 0; k < n; k++){
+            struct io_slot *s = &slots[k];
+            stats->syscalls += s->syscalls;
+            stats->files++;
+            if (s->error)
+                stats->failed++;
+            else{
+                stats->bytes_in += s->block.len;
+                stats->bytes_out += s->block.out_len;
+            }
+            for (int j = 0; j < JUNK_REASONS; j++)
+                stats->junk.rejected[j] += s->block.junk.rejected[j];
+            stats->junk.checked += s->block.junk.checked;
+            free(s->output_name);
+        }
+        stats->batches++;
+    }
+
+    io_group_stop(&g);
+    if (stats->uring)
+        uring_free(&r);
+    for (int k = 0; k < IO_BATCH; k++){
+        free(slots[k].block.text);
+        free(slots[k].block.out);
+    }
+    arena_free(&thread_arena);
+    stats->elapsed = now_seconds() - t0;
+    return stats->failed;
+}
+
+void print_io_stats(struct io_stats *stats)
+{
+    double mb = (stats->bytes_in + stats->bytes_out) / 1e6;
+    printf("e/s par lot (%s, %d threads) : %lu fichiers en %lu lots, %lu echecs, %.3f s\n",
+           stats->uring ? "io_uring" : "threads", stats->nb_threads, stats->files, stats->batches,
+           stats->failed, stats->elapsed);
+    printf("  %.0f fichiers/s, %.2f Mo/s (lu %lu, ecrit %lu octets)",
+           stats->elapsed > 0 ? stats->files / stats->elapsed : 0, stats->elapsed > 0 ? mb / stats->elapsed : 0,
+           stats->bytes_in, stats->bytes_out);
+    if (stats->uring)
+        printf(", %.3f s d'e/s", stats->io);
+    printf("\n");
+    printf("  %lu appels systeme, %.2f par fichier\n",
+           stats->syscalls, stats->files ? (double)stats->syscalls / stats->files : 0);
+    print_junk_stats(&stats->junk);
+}
+
+/////////////////////////// PARTIE MODIFICATION ///////////////////////////////
+/*
+    Document corrige en memoire : table de morceaux (piece table) sur le texte
+    OCR d'origine, les corrections etant ajoutees dans l'arene du document.
+    Chaque token (mot ou suite de separateurs) est un morceau, et un arbre de
+    Fenwick sur la longueur des morceaux donne l'offset du mot N dans le
+    fichier corrige en O(log n). Remplacer un mot ne touche que son morceau :
+    pas de nouvelle passe de correction sur tout le document.
+*/
+
+struct piece {
+    const char *text;   // dans orig ou dans l'arene du document
+    size_t length;
+};
+
+struct document {
+    struct arena arena; // tout le document est libere d'un coup
+    char *orig;
+    size_t orig_len;
+    struct piece *pieces;
+    int nb_pieces;
+    long *fenwick;      // longueur courante des morceaux, indices 1..nb_pieces
+    int *word_piece;    // mot i -> indice de son morceau
+    struct piece *ocr_words; // mot i dans le texte d'origine
+    int *first_maj;
+    int nb_words;
+    char *filename_dupli;
+};
+
+static void fenwick_add(long *tree, int n, int i, long delta)
+{
+    for (i++; i <= n; i += i & -i)
+        tree[i] += delta;
+}
+
+static long fenwick_prefix(long *tree, int i) // somme des morceaux [0, i)
+{
+    long r = 0;
+    for (; i > 0; i -= i & -i)
+        r += tree[i];
+    return r;
+}
+
+// Fin du token (mot ou suite de separateurs) qui commence en i
+static size_t document_token_end(struct document *doc, size_t i)
+{
+    int word = utf8_word_char(doc->orig, doc->orig_len, i) != 0;
+    while (i < doc->orig_len){
+        size_t n = utf8_word_char(doc->orig, doc->orig_len, i);
+        if ((n != 0) != word)
+            break;
+        if (n == 0)
+            utf8_decode(doc->orig, doc->orig_len, &i);
+        else
+            i += n;
+    }
+    return i;
+}
+
+// Copie en minuscules du mot d'origine numero index_word (thread_arena)
+static char *document_ocr_word(struct document *doc, int index_word)
+{
+    struct piece *p = &doc->ocr_words[index_word];
+    char *word = arena_alloc(&thread_arena, p->length + 1);
+    utf8_fold(word, p->text, p->length);
+    return word;
+}
+
+// Suggestion numero mod pour le mot index_word (thread_arena)
+// mod < 0 : le mot OCR d'origine, mod >= 0 : correction(word, mod, 0)
+static char *document_suggestion(struct document *doc, int index_word, int mod)
+{
+    char *word = document_ocr_word(doc, index_word);
+    if (mod < 0 || utf8_length(word) < 3){
+        struct piece *p = &doc->ocr_words[index_word];
+        memcpy(word, p->text, p->length);
+        return word;
+    }
+    // premiere passe (mod == 0) : meme filtre des dechets que first_file_junk
+    char *r = word;
+    if (mod != 0 || (exist_eng(word) == 2 && !junk_count(default_lexicon(), word, NULL)))
+        r = correction(word, mod, 0);
+    if (doc->first_maj[index_word] == 1)
+        utf8_upper_first(r);
+    return r;
+}
+
+static void document_set_word(struct document *doc, int index_word, const char *str)
+{
+    int ip = doc->word_piece[index_word];
+    struct piece *p = &doc->pieces[ip];
+    size_t len = strlen(str);
+    fenwick_add(doc->fenwick, doc->nb_pieces, ip, (long)len - (long)p->length);
+    p->text = arena_strdup(&doc->arena, str);
+    p->length = len;
+}
+
+// 1 si tous les morceaux a partir de from_piece ont ete ecrits, 0 sinon
+static int document_write(struct document *doc, FILE *file, int from_piece)
+{
+    for (int i = from_piece; i < doc->nb_pieces; i++)
+        if (fwrite(doc->pieces[i].text, 1, doc->pieces[i].length, file) != doc->pieces[i].length)
+            return 0;
+    return 1;
+}
+
+long document_length(struct document *doc)
+{
+    return fenwick_prefix(doc->fenwick, doc->nb_pieces);
+}
+
+// Offset du mot index_word dans le fichier corrige, en O(log n)
+long document_word_offset(struct document *doc, int index_word)
+{
+    return fenwick_prefix(doc->fenwick, doc->word_piece[index_word]);
+}
+
+struct document *document_create(char* filename) // free with document_free
+{
+    FILE* file = fopen(filename,"r");
+    if (file == NULL)
+        return NULL;
+    struct document *doc = calloc(1, sizeof(struct document));
+    fseek(file, 0, SEEK_END);
+    doc->orig_len = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    doc->orig = arena_alloc(&doc->arena, doc->orig_len + 1);
+    doc->orig_len = fread(doc->orig, 1, doc->orig_len, file);
+    doc->orig[doc->orig_len] = '\0';
+    fclose(file);
+
+    // decoupage en morceaux : suites de lettres et suites de separateurs
+    size_t i = 0;
+    while (i < doc->orig_len){
+        size_t start = i;
+        i = document_token_end(doc, i);
+        doc->nb_pieces++;
+        if (utf8_word_char(doc->orig, doc->orig_len, start))
+            doc->nb_words++;
+    }
+    doc->pieces = arena_alloc(&doc->arena, sizeof(struct piece) * (doc->nb_pieces + 1));
+    doc->fenwick = arena_alloc(&doc->arena, sizeof(long) * (doc->nb_pieces + 1));
+    memset(doc->fenwick, 0, sizeof(long) * (doc->nb_pieces + 1));
+    doc->word_piece = arena_alloc(&doc->arena, sizeof(int) * (doc->nb_words + 1));
+    doc->ocr_words = arena_alloc(&doc->arena, sizeof(struct piece) * (doc->nb_words + 1));
+    doc->first_maj = arena_alloc(&doc->arena, sizeof(int) * (doc->nb_words + 1));
+    int ip = 0;
+    int iw = 0;
+    i = 0;
+    while (i < doc->orig_len){
+        size_t start = i;
+        int word = utf8_word_char(doc->orig, doc->orig_len, i) != 0;
+        i = document_token_end(doc, i);
+        doc->pieces[ip].text = doc->orig + start;
+        doc->pieces[ip].length = i - start;
+        fenwick_add(doc->fenwick, doc->nb_pieces, ip, i - start);
+        if (word){
+            doc->word_piece[iw] = ip;
+            doc->ocr_words[iw] = doc->pieces[ip];
+            doc->first_maj[iw] = utf8_first_upper(doc->orig + start, i - start);
+            iw++;
+        }
+        ip++;
+    }
+
+    // premiere passe de correction, comme first_file
+    for (iw = 0; iw < doc->nb_words; iw++){
+        struct arena_mark mark = arena_mark(&thread_arena);
+        document_set_word(doc, iw, document_suggestion(doc, iw, 0));
+        arena_release(&thread_arena, mark);
+    }
+
+    char* start = "c_";
+    doc->filename_dupli = arena_alloc(&doc->arena, strlen(start) + strlen(filename) + 1);
+    strcpy(doc->filename_dupli, start);
+    strcat(doc->filename_dupli, filename);
+    FILE* file_dupli = fopen(doc->filename_dupli,"w");
+    if (file_dupli != NULL){
+        document_write(doc, file_dupli, 0);
+        fclose(file_dupli);
+    }
+    return doc;
+}
+
+// Remplace le mot index_word par sa suggestion numero mod et met a jour le
+// fichier corrige : si la longueur ne change pas, seuls les octets du mot
+// sont reecrits, sinon la fin du fichier a partir du mot.
+// Renvoie 0 si le mot est invalide ou si la reecriture du fichier a echoue.
+int modification(struct document *doc, int index_word, int mod)
+{
+    if (index_word < 0 || index_word >= doc->nb_words)
+        return 0;
+    int ip = doc->word_piece[index_word];
+    size_t old_length = doc->pieces[ip].length;
+    struct arena_mark mark = arena_mark(&thread_arena);
+    document_set_word(doc, index_word, document_suggestion(doc, index_word, mod));
+    arena_release(&thread_arena, mark);
+
+    FILE* file_dupli = fopen(doc->filename_dupli,"r+");
+    if (file_dupli == NULL)
+        return 0;
+    int ok = fseek(file_dupli, document_word_offset(doc, index_word), SEEK_SET) == 0;
+    if (ok && doc->pieces[ip].length == old_length){
+        ok = fwrite(doc->pieces[ip].text, 1, old_length, file_dupli) == old_length;
+    }
+    else if (ok){
+        ok = document_write(doc, file_dupli, ip)
+            && fflush(file_dupli) == 0
+            && ftruncate(fileno(file_dupli), document_length(doc)) == 0;
+    }
+    if (fclose(file_dupli) != 0)
+        ok = 0;
+    return ok;
+}
+
+void document_free(struct document *doc)
+{
+    arena_free(&doc->arena);
+    free(doc);
+}
+
+/////////////////////////// PARTIE BENCHMARK ////////////////////////////////
+
+#define BENCH_QUERIES 16
+
+// Mots du paquet l avec une lettre changee, pour simuler des erreurs OCR
+static int bench_queries(struct bucket *b, int l, char queries[][LEXICON_MAX_LENGTH + 1])
+{
+    int nb = b->count < BENCH_QUERIES ? b->count : BENCH_QUERIES;
+    for (int q = 0; q < nb; q++){
+        memcpy(queries[q], b->words + (long)q * b->count / nb * b->stride, l + 1);
+        queries[q][(q * 7) % l] = 'a' + (q * 11) % 26;
+    }
+    return nb;
+}
+
+// Temps par comparaison, noyau generique contre noyau specialise, sur le
+// paquet de chaque longueur LEV_MIN..LEV_MAX (mot OCR de meme longueur)
+void benchmark_kernels(struct lexicon *lex)
+{
+    char queries[BENCH_QUERIES][LEXICON_MAX_LENGTH + 1];
+    printf("longueur   mots   generique   specialise   gain   hamming\n");
+    for (int l = LEV_MIN; l <= LEV_MAX; l++){
+        struct bucket *b = &lex->buckets[l];
+        if (b->count == 0 || b->stride != l + 1)
+            continue;
+        int nb = bench_queries(b, l, queries);
+        unsigned long check_generic = 0, check_kernel = 0, check_hamming = 0;
+        double t = now_seconds();
+        for (int q = 0; q < nb; q++)
+            for (int i = 0; i < b->count; i++)
+                check_generic += levenshtein_ascii(b->words + i * b->stride, l, queries[q], l);
+        double generic = now_seconds() - t;
+        t = now_seconds();
+        for (int q = 0; q < nb; q++)
+            for (int i = 0; i < b->count; i++)
+                check_kernel += lev_kernels[l][l](b->words + i * b->stride, queries[q]);
+        double kernel = now_seconds() - t;
+        double hamming = 0;
+        if (b->packed_words > 0){
+            unsigned char h[PACKED_BLOCK];
+            struct packed_query pq;
+            t = now_seconds();
+            for (int q = 0; q < nb; q++){
+                pack_query(b, queries[q], 0, &pq);
+                for (int start = 0; start < b->count; start += PACKED_BLOCK){
+                    int end = start + PACKED_BLOCK < b->count ? start + PACKED_BLOCK : b->count;
+                    packed_hamming_block(b, start, end, &pq, h);
+                    for (int i = 0; i < end - start; i++)
+                        check_hamming += h[i];
+                }
+            }
+            hamming = now_seconds() - t;
+        }
+        double n = (double)nb * b->count;
+        printf("%8d %6d %9.1f ns %10.1f ns %5.2fx", l, b->count, 1e9 * generic / n, 1e9 * kernel / n,
+               kernel > 0 ? generic / kernel : 0);
+        if (b->packed_words > 0)
+            printf(" %8.2f ns", 1e9 * hamming / n);
+        else
+            printf("        -");
+        // Hamming majore Levenshtein : la somme ne peut pas etre plus petite
+        int ok = check_generic == check_kernel && (b->packed_words == 0 || check_hamming >= check_kernel);
+        printf("%s\n", ok ? "" : "  (ERREUR)");
+    }
+}
+
+// Octets utilises par un paquet plat : mots au pas stride, table de
+// hachage et mots compactes (comme front_bucket.bytes, sans les blocs
+// d'arene a moitie vides)
+static size_t bucket_bytes(struct bucket *b)
+{
+    size_t bytes = (size_t)b->count * b->stride;
+    if (b->hash != NULL)
+        bytes += (b->hash_mask + 1) * sizeof(unsigned int);
+    if (b->masks != NULL)
+        bytes += (size_t)b->count * sizeof(uint32_t);
+    return bytes + (size_t)b->count * b->packed_words * sizeof(uint64_t);
+}
+
+// Memoire par mot et temps de parcours (correction complete d'un mot de
+// meme longueur) du lexique plat contre le lexique compresse
+void benchmark_front(struct lexicon *lex, struct front_lexicon *fl)
+{
+    char queries[BENCH_QUERIES][LEXICON_MAX_LENGTH + 1];
+    size_t flat_total = 0, front_total = 0;
+    printf("longueur   mots   plat (o/mot)  compresse (o/mot)   plat      compresse   cout\n");
+    for (int l = LEV_MIN; l <= LEV_MAX; l++){
+        struct bucket *b = &lex->buckets[l];
+        struct front_bucket *fb = &fl->buckets[l];
+        if (b->count == 0 || b->stride != l + 1)
+            continue;
+        size_t flat = bucket_bytes(b);
+        flat_total += flat;
+        front_total += fb->bytes;
+        int nb = bench_queries(b, l, queries);
+        int errors = 0;
+        double t = now_seconds();
+        for (int q = 0; q < nb; q++){
+            struct arena_mark mark = arena_mark(&thread_arena);
+            lexicon_correction(lex, queries[q], 0, 0);
+            arena_release(&thread_arena, mark);
+        }
+        double flat_time = now_seconds() - t;
+        t = now_seconds();
+        for (int q = 0; q < nb; q++){
+            struct arena_mark mark = arena_mark(&thread_arena);
+            front_correction(fl, queries[q], 0, 0);
+            arena_release(&thread_arena, mark);
+        }
+        double front_time = now_seconds() - t;
+        for (int q = 0; q < nb; q++){
+            struct arena_mark mark = arena_mark(&thread_arena);
+            errors += strcmp(lexicon_correction(lex, queries[q], q % 3, 0), front_correction(fl, queries[q], q % 3, 0)) != 0;
+            errors += front_exist(fl, b->words + (long)q * b->count / nb * b->stride) != 1;
+            arena_release(&thread_arena, mark);
+        }
+        double n = (double)nb * b->count;
+        printf("%8d %6d %12.1f %16.1f %9.1f ns %9.1f ns %5.2fx%s\n", l, b->count, (double)flat / b->count,
+               (double)fb->bytes / fb->count, 1e9 * flat_time / n, 1e9 * front_time / n,
+               flat_time > 0 ? front_time / flat_time : 0, errors ? "  (ERREUR)" : "");
+    }
+    printf("total : plat %.1f Mo, compresse %.1f Mo, %d mots\n", flat_total / 1e6, front_total / 1e6, fl->nb_words);
+}
+
+/*
+    Tests differentiels des noyaux de distance : chaque noyau (ASCII
+    specialise, ASCII generique, code points) et l'explication d'une
+    correction sont compares a une matrice complete sur les code points,
+    sur des mots pseudo-aleatoires (ASCII, accents, ideogrammes). Le script
+    d'explication doit avoir la longueur de la distance et, applique au mot
+    OCR, redonner le mot corrige.
+*/
+#define TEST_WORDS 20000
+
+static const char *test_alphabet[] = {"a", "b", "c", "e", "T", "\xc3\xa9", "\xc3\xbc", "\xc5\x93", "\xe4\xb8\xad", "\xf0\x9f\x98\x80"};
+
+static unsigned int test_random(unsigned int *seed)
+{
+    *seed = *seed * 1103515245u + 12345u;
+    return *seed >> 16;
+}
+
+// Mot de length caracteres ; ascii : seulement les 5 premieres lettres
+static void test_word(unsigned int *seed, int length, int ascii, char *out)
+{
+    int nb = ascii ? 5 : sizeof(test_alphabet) / sizeof(test_alphabet[0]);
+    out[0] = '\0';
+    for (int i = 0; i < length; i++)
+        strcat(out, test_alphabet[test_random(seed) % nb]);
+}
+
+static unsigned int test_reference_distance(const char *str1, const char *str2)
+{
+    size_t len1 = strlen(str1), len2 = strlen(str2);
+    unsigned int *cp1 = malloc((len1 + 1) * sizeof(unsigned int));
+    unsigned int *cp2 = malloc((len2 + 1) * sizeof(unsigned int));
+    len1 = utf8_to_codepoints(str1, len1, cp1);
+    len2 = utf8_to_codepoints(str2, len2, cp2);
+    unsigned int *d = malloc((len1 + 1) * (len2 + 1) * sizeof(unsigned int));
+    for (size_t i = 0; i <= len1; i++)
+        for (size_t j = 0; j <= len2; j++){
+            unsigned int *cell = &d[i * (len2 + 1) + j];
+            if (i == 0 || j == 0)
+                *cell = i + j;
+            else
+                *cell = min3(d[(i - 1) * (len2 + 1) + j] + 1, d[i * (len2 + 1) + j - 1] + 1,
+                             d[(i - 1) * (len2 + 1) + j - 1] + (cp1[i - 1] != cp2[j - 1]));
+        }
+    unsigned int distance = d[len1 * (len2 + 1) + len2];
+    free(cp1);
+    free(cp2);
+    free(d);
+    return distance;
+}
+
+// Applique le script ops a ocr_word ; 1 si on retrouve corrected
+static int test_apply(const char *ocr_word, const char *corrected, struct edit_op *ops, unsigned int nb_ops)
+{
+    size_t len = strlen(ocr_word), i = 0, n = 0;
+    unsigned int k = 0;
+    char *out = arena_alloc(&thread_arena, 4 * (len + nb_ops) + 1);
+    for (unsigned int o = 0; o < nb_ops; o++){
+        while (k < ops[o].pos && i < len){
+            size_t from = i;
+            utf8_decode(ocr_word, len, &i);
+            memcpy(out + n, ocr_word + from, i - from);
+            n += i - from;
+            k++;
+        }
+        if (ops[o].type != INSERTION){
+            utf8_decode(ocr_word, len, &i);
+            k++;
+        }
+        if (ops[o].type != DELETION)
+            n += utf8_encode(ops[o].arg2, out + n);
+    }
+    memcpy(out + n, ocr_word + i, len - i);
+    out[n + len - i] = '\0';
+    return strcmp(out, corrected) == 0;
+}
+
+// Renvoie le nombre d'erreurs
+int test_kernels(void)
+{
+    unsigned int seed = 42;
+    int errors = 0, tests = 0;
+    char word1[4 * 320 + 1], word2[4 * 320 + 1];
+    for (int t = 0; t < TEST_WORDS; t++){
+        // quelques mots longs pour la ligne hors pile et Hirschberg
+        int long_words = t % 200 == 0;
+        int length1 = long_words ? 150 + test_random(&seed) % 170 : test_random(&seed) % 25;
+        int length2 = long_words ? (int)(150 + test_random(&seed) % 170) : (test_random(&seed) % 4 == 0 ? length1 : (int)(test_random(&seed) % 25));
+        int ascii = t % 2;
+        test_word(&seed, length1, ascii, word1);
+        // mot proche : copie de word1 avec quelques changements
+        if (length2 == length1 && !long_words){
+            strcpy(word2, word1);
+            if (length1 > 0)
+                word2[test_random(&seed) % strlen(word2)] = 'a';
+            if (!ascii)
+                utf8_fold(word2, word2, strlen(word2));
+        }
+        else
+            test_word(&seed, length2, ascii, word2);
+        if (!ascii && (test_random(&seed) & 1)){
+            // un mot ASCII contre un mot accentue
+            test_word(&seed, length2, 1, word2);
+        }
+        // la copie modifiee peut couper une sequence UTF-8 : on la refait valide
+        size_t len2 = strlen(word2);
+        unsigned int *cp = malloc((len2 + 1) * sizeof(unsigned int));
+        size_t nb_cp = utf8_to_codepoints(word2, len2, cp);
+        len2 = 0;
+        for (size_t k = 0; k < nb_cp; k++)
+            len2 += utf8_encode(cp[k], word2 + len2);
+        word2[len2] = '\0';
+        free(cp);
+
+        struct arena_mark mark = arena_mark(&thread_arena);
+        unsigned int expected = test_reference_distance(word1, word2);
+        unsigned int distance = levenshtein_distance(word1, word2);
+        struct edit_op *ops;
+        unsigned int nb_ops = explain_correction(word1, word2, &ops);
+        int ok = distance == expected && nb_ops == expected && test_apply(word1, word2, ops, nb_ops);
+        size_t l1 = strlen(word1);
+        if (ascii && l1 == len2 && !long_words){
+            ok = ok && levenshtein_ascii(word1, l1, word2, len2) == expected;
+            if (l1 >= LEV_MIN && l1 <= LEV_MAX)
+                ok = ok && lev_kernels[l1][len2](word1, word2) == expected;
+        }
+        arena_release(&thread_arena, mark);
+        if (!ok && errors < 5)
+            printf("ERREUR : \"%s\" / \"%s\" : attendu %u, distance %u, explication %u\n", word1, word2, expected, distance, nb_ops);
+        errors += !ok;
+        tests++;
+    }
+    printf("noyaux de distance : %d tests, %d erreurs\n", tests, errors);
+    return errors;
+}
+
+// Exemples d'espaces perdus ou en trop et leur correction attendue
+static const char *test_segments[][2] = {
+    {"Thisis a test.", "This is a test."},
+    {"the end ofthe day", "the end of the day"},
+    {"inthe house", "in the house"},
+    {"go tothe door", "go to the door"},
+    {"itwas late", "it was late"},
+    {"a problme here", "a problem here"},
+    {"cor rection", "correction"},
+    {"an exam ple", "an example"},
+    {"a black bird", "a black bird"},
+    {"a lot of it", "a lot of it"},
+};
+
+// Renvoie le nombre d'erreurs
+int test_segment(void)
+{
+    struct lexicon *lex = default_lexicon();
+    if (lex == NULL){
+        printf("segmentation : dictionnaire absent\n");
+        return 1;
+    }
+    int errors = 0, tests = sizeof(test_segments) / sizeof(test_segments[0]);
+    for (int t = 0; t < tests; t++){
+        char *out = NULL;
+        size_t size = 0;
+        FILE *file = open_memstream(&out, &size);
+        struct segment_stats stats;
+        memset(&stats, 0, sizeof(struct segment_stats));
+        segment_text(lex, test_segments[t][0], strlen(test_segments[t][0]), file, &stats);
+        fclose(file);
+        if (strcmp(out, test_segments[t][1]) != 0){
+            printf("ERREUR : \"%s\" donne \"%s\", attendu \"%s\"\n", test_segments[t][0], out, test_segments[t][1]);
+            errors++;
+        }
+        free(out);
+    }
+    printf("segmentation : %d tests, %d erreurs\n", tests, errors);
+    return errors;
+}
+
+#define TEST_QUERIES 400
+
+// Mot du lexique avec une erreur OCR simulee (lettre changee, perdue ou
+// ajoutee), dans out
+static void test_query_word(unsigned int *seed, struct lexicon *lex, char *out)
+{
+    struct bucket *b;
+    do
+        b = &lex->buckets[3 + test_random(seed) % 12];
+    while (b->count == 0);
+    strcpy(out, b->words + (long)(test_random(seed) % b->count) * b->stride);
+    size_t len = strlen(out);
+    size_t i = test_random(seed) % len;
+    if ((unsigned char)out[i] >= 0x80)
+        return;
+    switch (test_random(seed) % 3){
+    case 0:
+        out[i] = 'a' + test_random(seed) % 26;
+        break;
+    case 1:
+        memmove(out + i, out + i + 1, len - i);
+        break;
+    default:
+        memmove(out + i + 1, out + i, len - i + 1);
+        out[i] = 'a' + test_random(seed) % 26;
+    }
+}
+
+// Toutes les recherches doivent donner le meme mot que lexicon_correction :
+// par lot, sur la forme compressee, et avec un budget illimite.
+// Renvoie le nombre d'erreurs
+int test_equivalence(void)
+{
+    struct lexicon *lex = default_lexicon();
+    if (lex == NULL){
+        printf("equivalence : dictionnaire absent\n");
+        return 1;
+    }
+    struct front_lexicon *fl = front_lexicon_build(lex);
+    unsigned int seed = 7;
+    int errors = 0;
+    char words[TEST_QUERIES][LEXICON_MAX_LENGTH + 2];
+    struct query *queries = malloc(TEST_QUERIES * sizeof(struct query));
+    for (int q = 0; q < TEST_QUERIES; q++){
+        test_query_word(&seed, lex, words[q]);
+        query_init(&queries[q], words[q], test_random(&seed) % 5, (int)(test_random(&seed) % 3) - 1);
+    }
+    lexicon_correction_batch(lex, queries, TEST_QUERIES);
+    for (int q = 0; q < TEST_QUERIES; q++){
+        struct arena_mark mark = arena_mark(&thread_arena);
+        char *word = words[q];
+        int nb = queries[q].nb, plus = queries[q].plus;
+        char *expected = lexicon_correction(lex, word, nb, plus);
+        const char *batch = query_result(lex, &queries[q]);
+        char *front = front_correction(fl, word, nb, plus);
+        int truncated;
+        char *budget = lexicon_correction_budget(lex, word, nb, plus, NULL, &truncated, NULL);
+        int nb_solutions = lexicon_nb_solutions(lex, word, plus);
+        int front_solutions = front_nb_solutions(fl, word, plus);
+        int ok = strcmp(batch, expected) == 0 && strcmp(front, expected) == 0
+            && strcmp(budget, expected) == 0 && !truncated && nb_solutions == front_solutions;
+        if (!ok && errors < 5)
+            printf("ERREUR : \"%s\" (nb %d, plus %d) : %s, lot %s, compresse %s, budget %s, solutions %d/%d\n",
+                   word, nb, plus, expected, batch, front, budget, nb_solutions, front_solutions);
+        errors += !ok;
+        arena_release(&thread_arena, mark);
+    }
+    free(queries);
+    front_lexicon_free(fl);
+    printf("equivalence des recherches : %d tests, %d erreurs\n", TEST_QUERIES, errors);
+    return errors;
+}
+
+// Petit lexique francais ecrit dans un repertoire temporaire, ajoute au
+// registre a cote de "eng"
+static const char *test_french[] = {
+    "le", "la", "de", "et", "un", "une", "les", "est", "des", "nuit", "dans", "chat", "noir",
+    "elle", "nous", "pour", "avec", "pomme", "mange", "petit", "grand", "rouge", "blanc",
+    "chien", "jardin", "soleil", "maison", "oiseau", "fromage", "voiture", "fenetre",
+    "lumiere", "chanson", "village", "toujours", "heureux", "beaucoup",
+};
+
+// Lignes d'un texte melange : langue attendue, mot OCR, correction attendue
+static const struct {
+    const char *line;
+    const char *lang;
+    const char *word;
+    const char *corrected;
+} test_multi[] = {
+    {"le chat noir mange une pomme dans le jardin", "fra", "pomne", "pomme"},
+    {"elle chante toujours une chanson dans la maison", "fra", "fromege", "fromage"},
+    {"the cat is eating an apple in the garden", "eng", "eatinh", "eating"},
+    {"the sunlight falls on the house of the village", "eng", "sunlighr", "sunlight"},
+    // un mot d'un autre lexique reste tel quel
+    {"we had some bread and wine in the garden", "eng", "toujours", "toujours"},
+};
+
+// Renvoie le nombre d'erreurs
+int test_registry(void)
+{
+    if (default_lexicon() == NULL){
+        printf("registre : dictionnaire absent\n");
+        return 1;
+    }
+    char dir[] = "/tmp/lexiqueXXXXXX";
+    if (mkdtemp(dir) == NULL){
+        printf("registre : repertoire temporaire impossible\n");
+        return 1;
+    }
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "%s/length_", dir);
+    int nb_french = sizeof(test_french) / sizeof(test_french[0]);
+    for (int l = 1; l <= LEXICON_MAX_LENGTH; l++){
+        struct arena_mark mark = arena_mark(&thread_arena);
+        FILE *file = NULL;
+        for (int i = 0; i < nb_french; i++){
+            if ((int)strlen(test_french[i]) != l)
+                continue;
+            if (file == NULL)
+                file = fopen(convert_prefix_length_filename(prefix, l), "w");
+            if (file != NULL)
+                fprintf(file, "%s\r\n", test_french[i]);
+        }
+        if (file != NULL)
+            fclose(file);
+        arena_release(&thread_arena, mark);
+    }
+    int fra = registry_add("fra", prefix);
+    for (int l = 1; l <= LEXICON_MAX_LENGTH; l++){
+        struct arena_mark mark = arena_mark(&thread_arena);
+        unlink(convert_prefix_length_filename(prefix, l));
+        arena_release(&thread_arena, mark);
+    }
+    rmdir(dir);
+    if (fra < 0){
+        printf("registre : lexique de test non charge\n");
+        return 1;
+    }
+
+    int errors = 0, tests = sizeof(test_multi) / sizeof(test_multi[0]);
+    for (int t = 0; t < tests; t++){
+        struct arena_mark mark = arena_mark(&thread_arena);
+        int sure;
+        int lang = lexicon_detect(test_multi[t].line, strlen(test_multi[t].line), &sure);
+        char *word = arena_strdup(&thread_arena, test_multi[t].word);
+        char *corrected = registry_correction(word, lang, sure, NULL);
+        if (strcmp(lexicons[lang]->name, test_multi[t].lang) != 0 || !sure || strcmp(corrected, test_multi[t].corrected) != 0){
+            printf("ERREUR : \"%s\" : langue %s (%s), \"%s\" donne \"%s\", attendu %s et \"%s\"\n", test_multi[t].line,
+                   lexicons[lang]->name, sure ? "sure" : "incertaine", test_multi[t].word, corrected,
+                   test_multi[t].lang, test_multi[t].corrected);
+            errors++;
+        }
+        arena_release(&thread_arena, mark);
+    }
+    // le registre redevient celui des autres tests
+    lexicon_free(lexicons[--nb_lexicons]);
+    printf("registre a deux lexiques : %d tests, %d erreurs\n", tests, errors);
+    return errors;
+}
+
+///////////////////////////// MAIN OPENFILE /////////////////////////////////
+/*
+int main(int argc, char* argv[]){
+
+    //correction_solutions(argv[1], 0, 1);
+    int first = 1;
+    int done = 0;
+    if (argc == 3 && strcmp("file" , argv[1]) == 0){
+        first = 0;
+        done = 1;
+        first_file(argv[2]);
+    }
+    
+    
+    int display_argv = 0; // FALSE
+    
+    if (argc == 2){
+        //char* r = correction(argv[1], 0, 0);
+        //printf("correction : %s\n", r);
+        //free(r);
+        int argv2 = 0;
+        int argv3 = 0;
+        if (display_argv == 1){
+            printf("argv2 = %i\n",argv2);
+            printf("argv3 = %i\n", argv3);
+        }
+        correction_solutions(argv[1], argv2, argv3);
+        done = 1;
+    } 
+    if (first == 1 && argc == 3){
+        int argv2 = transform_str_int(argv[2]);
+        int argv3 = 0;
+        if (display_argv == 1){
+            printf("argv2 = %i\n",argv2);
+            printf("argv3 = %i\n", argv3);
+        }
+        //char* r = correction(argv[1], argv2, 0);
+        //printf("correction : %s\n", r);
+        //free(r);
+        correction_solutions(argv[1],argv2,argv3);
+        done = 1;
+    }
+    if (argc == 4){
+        int argv2 = transform_str_int(argv[2]);
+        int argv3 = transform_str_int(argv[3]);
+        if (display_argv == 1){
+            printf("argv2 = %i\n",argv2);
+            printf("argv3 = %i\n", argv3);
+        }
+        //char* r = correction(argv[1], argv2, argv3);
+        //printf("correction : %s\n", r);
+        //free(r);
+        correction_solutions(argv[1],argv2, argv3);
+        done = 1;
+    }
+    if (done == 0){
+        printf("Usage : ./a.out [word] [length_min] [length_max]\n");
+    }
+
+    return 0;
+}*/
+
+int main(int argc, char* argv[]){
+    if (argc == 2 && strcmp("bench", argv[1]) == 0){
+        struct lexicon *lex = default_lexicon();
+        if (lex == NULL)
+            return 1;
+        benchmark_kernels(lex);
+        registry_free();
+        return 0;
+    }
+    if (argc == 2 && strcmp("test", argv[1]) == 0){
+        int errors = test_kernels() + test_segment() + test_equivalence() + test_registry();
+        registry_free();
+        return errors == 0 ? 0 : 1;
+    }
+    if (argc == 2 && strcmp("front", argv[1]) == 0){
+        struct lexicon *lex = default_lexicon();
+        if (lex == NULL)
+            return 1;
+        struct front_lexicon *fl = front_lexicon_build(lex);
+        benchmark_front(lex, fl);
+        front_lexicon_free(fl);
+        registry_free();
+        return 0;
+    }
+    if (argc >= 3 && strcmp("files", argv[1]) == 0){
+        struct io_stats stats;
+        long failed = first_files_io(argv + 2, argc - 2, sysconf(_SC_NPROCESSORS_ONLN), &stats);
+        if (failed >= 0)
+            print_io_stats(&stats);
+        registry_free();
+        return failed == 0 ? 0 : 1;
+    }
+    if (argc == 3 && strcmp("file", argv[1]) == 0){
+        struct junk_stats junk;
+        memset(&junk, 0, sizeof(struct junk_stats));
+        first_file_junk(argv[2], &junk);
+        print_junk_stats(&junk);
+        registry_free();
+        return 0;
+    }
+    if (argc == 3 && strcmp("batch", argv[1]) == 0){
+        struct junk_stats junk;
+        memset(&junk, 0, sizeof(struct junk_stats));
+        first_file_batch(argv[2], &junk);
+        print_junk_stats(&junk);
+        registry_free();
+        return 0;
+    }
+    if ((argc == 3 || argc == 4) && strcmp("pipeline", argv[1]) == 0){
+        struct pipeline_stats stats;
+        int nb_workers = argc == 4 ? transform_str_int(argv[3]) : sysconf(_SC_NPROCESSORS_ONLN);
+        first_file_pipeline(argv[2], nb_workers, &stats);
+        print_pipeline_stats(&stats);
+        registry_free();
+        return 0;
+    }
+    if (argc == 3 && strcmp("segment", argv[1]) == 0){
+        struct segment_stats stats;
+        first_file_segment(argv[2], &stats);
+        print_segment_stats(&stats);
+        registry_free();
+        return 0;
+    }
+    // xml <fichier> [seuil 0..100, 90 par defaut]
+    if ((argc == 3 || argc == 4) && strcmp("xml", argv[1]) == 0){
+        struct ocr_xml_stats stats;
+        int failed = first_file_ocr_xml(argv[2], argc == 4 ? atof(argv[3]) : 90, &stats);
+        if (failed == 0)
+            print_ocr_xml_stats(&stats);
+        registry_free();
+        return failed == 0 ? 0 : 1;
+    }
+    // multi <fichier> [nom:prefixe]... : "eng" puis les lexiques donnes,
+    // la langue est detectee ligne par ligne
+    if (argc >= 3 && strcmp("multi", argv[1]) == 0){
+        int failed = default_lexicon() == NULL;
+        for (int i = 3; i < argc && !failed; i++){
+            char *colon = strchr(argv[i], ':');
+            if (colon == NULL){
+                printf("lexique \"%s\" : attendu nom:prefixe\n", argv[i]);
+                failed = 1;
+                break;
+            }
+            *colon = '\0';
+            if (registry_add(argv[i], colon + 1) < 0){
+                printf("lexique %s : rien a charger depuis %s\n", argv[i], colon + 1);
+                failed = 1;
+            }
+        }
+        if (!failed){
+            struct junk_stats junk;
+            memset(&junk, 0, sizeof(struct junk_stats));
+            first_file_multi(argv[2], &junk);
+            print_junk_stats(&junk);
+        }
+        registry_free();
+        return failed;
+    }
+    // budget <mot> [secondes] [distances] : 0 pour pas de limite
+    if (argc >= 3 && argc <= 5 && strcmp("budget", argv[1]) == 0){
+        struct search_budget budget = {argc >= 4 ? atof(argv[3]) : 0, argc == 5 ? transform_str_int(argv[4]) : 0};
+        struct budget_stats stats;
+        memset(&stats, 0, sizeof(struct budget_stats));
+        correction_solutions_budget(argv[2], 0, 0, &budget, &stats);
+        print_budget_stats(&stats);
+        registry_free();
+        return 0;
+    }
 
-int main(){
     char* filename = "ocr_text.txt";
     char* filename_correction = "c_ocr_text.txt"; // fichier caché 
     char* str_ocr = "This is my girst correctjon!";
 
     put_in_file(str_ocr, filename);
 
+    // le lexique est charge avant : on ne compte que le travail par token
+    default_lexicon();
+    unsigned long allocations = nb_malloc;
     first_file(filename);
+    printf("allocations pendant first_file : %lu\n", nb_malloc - allocations);
 
     char* after_first_correction = from_file(filename_correction);
     printf("%s\n",after_first_correction);